@@ -0,0 +1,419 @@
+// Loopback benchmarks for tinySocket.
+// Build: cl /EHsc /O2 /I.. Benchmark.cpp
+// Each result is printed as one JSON object per line.
+#include "../tinySocket/TCPSocket.hpp"
+#include "../tinySocket/UDPSocket.hpp"
+#include "../tinySocket/Runtime.hpp"
+#include "../tinySocket/MemoryTransport.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+using namespace tinySocket;
+
+static double Now() {
+    static LARGE_INTEGER frequency = { };
+    if (frequency.QuadPart == 0)
+        ::QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    ::QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+static double Percentile(const std::vector<double>& sorted, double p) {
+    size_t index = static_cast<size_t>(p * sorted.size());
+    if (index >= sorted.size())
+        index = sorted.size() - 1;
+    return sorted[index];
+}
+
+static SocketAddr<AF_INET> Loopback(u_short port) {
+    return SocketAddr<AF_INET>(TEXT("127.0.0.1"), port);
+}
+
+template<typename _Socket>
+static u_short LocalPort(const _Socket& socket) {
+    return ntohs(socket.GetSocketName().sin_port);
+}
+
+// Closing a socket is how a benchmark unblocks a thread waiting on it before
+// joining that thread; the socket may already be closed.
+template<typename _Socket>
+static void CloseQuietly(_Socket& socket) {
+    try {
+        socket.Close();
+    } catch (DWORD) {
+    }
+}
+
+// Keeps the first error reported by any benchmark thread.
+static void SetFailure(std::atomic<DWORD>& failure, DWORD error) {
+    DWORD expected = 0;
+    failure.compare_exchange_strong(expected, error);
+}
+
+//----------------------------
+//  TCP ping-pong latency
+//----------------------------
+
+template<typename _Transport>
+static void TcpPingPong(const char* transport, int payload, int iterations) {
+    typename _Transport::ListenSocket listener;
+    listener.Bind(TEXT("127.0.0.1"), 0);
+    listener.Listen(1);
+    u_short port = LocalPort(listener);
+
+    DWORD failure = 0;
+    std::thread server([&]() {
+        bool accepted = false;
+        try {
+            typename _Transport::StreamSocket peer = listener.Accept();
+            peer.template SetOption<Option::NoDelay>(TRUE);
+            accepted = true;
+            std::vector<char> buffer(payload);
+            for (;;) {
+                peer.ReceiveExact(buffer.data(), payload);
+                peer.SendAll(buffer.data(), payload);
+            }
+        } catch (DWORD error) {
+            // Once accepted, an error is the client closing its end.
+            if (!accepted) {
+                failure = error;
+                CloseQuietly(listener);
+            }
+        }
+    });
+
+    typename _Transport::StreamSocket client;
+    std::vector<char> buffer(payload, 'x');
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    try {
+        client.template SetOption<Option::NoDelay>(TRUE);
+        client.Connect(Loopback(port));
+        for (int i = 0; i < iterations / 10; ++i) {
+            client.SendAll(buffer.data(), payload);
+            client.ReceiveExact(buffer.data(), payload);
+        }
+        for (int i = 0; i < iterations; ++i) {
+            double start = Now();
+            client.SendAll(buffer.data(), payload);
+            client.ReceiveExact(buffer.data(), payload);
+            samples.push_back((Now() - start) * 1e6);
+        }
+    } catch (DWORD) {
+        // Unblock a server still waiting in Accept before joining it.
+        CloseQuietly(client);
+        CloseQuietly(listener);
+        server.join();
+        throw;
+    }
+    client.Close();
+    server.join();
+    if (failure != 0)
+        throw failure;
+
+    std::sort(samples.begin(), samples.end());
+    printf("{\"benchmark\":\"tcp_pingpong\",\"transport\":\"%s\",\"payload\":%d,\"iterations\":%d,"
+           "\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,\"max_us\":%.2f}\n",
+           transport, payload, iterations,
+           Percentile(samples, 0.5), Percentile(samples, 0.99), Percentile(samples, 0.999),
+           samples.back());
+}
+
+//----------------------------
+//  TCP throughput
+//----------------------------
+
+static void TcpThroughput(int streams, long long total_bytes, int chunk) {
+    TCPListenSocket<AF_INET> listener;
+    listener.Bind(TEXT("127.0.0.1"), 0);
+    listener.Listen(streams);
+    u_short port = LocalPort(listener);
+    long long per_stream = total_bytes / streams;
+
+    std::atomic<DWORD> failure(0);
+    std::atomic<long long> received(0);
+    std::vector<std::thread> receivers;
+    std::thread acceptor([&]() {
+        try {
+            for (int i = 0; i < streams; ++i) {
+                TCPCommunicateSocket<AF_INET> peer = listener.Accept();
+                receivers.emplace_back([&received, &failure, chunk](TCPCommunicateSocket<AF_INET> peer) {
+                    std::vector<char> buffer(chunk);
+                    for (;;) {
+                        Result<int> length = peer.TryReceive(buffer.data(), chunk);
+                        if (!length)
+                            SetFailure(failure, length.GetError());
+                        if (!length || length.Value() == 0)
+                            break;
+                        received += length.Value();
+                    }
+                }, std::move(peer));
+            }
+        } catch (DWORD error) {
+            SetFailure(failure, error);
+        }
+    });
+
+    // Closing the clients ends every receiver, whether its peer was accepted
+    // before or after the failure.
+    std::vector<TCPCommunicateSocket<AF_INET>> clients;
+    auto abandon = [&]() {
+        CloseQuietly(listener);
+        for (TCPCommunicateSocket<AF_INET>& client : clients)
+            CloseQuietly(client);
+        if (acceptor.joinable())
+            acceptor.join();
+        for (std::thread& receiver : receivers)
+            receiver.join();
+    };
+
+    try {
+        for (int i = 0; i < streams; ++i) {
+            clients.emplace_back();
+            clients.back().Connect(Loopback(port));
+        }
+    } catch (DWORD error) {
+        SetFailure(failure, error);
+        abandon();
+        throw failure.load();
+    }
+    acceptor.join();
+    if (failure != 0) {
+        abandon();
+        throw failure.load();
+    }
+
+    double start = Now();
+    std::vector<std::thread> senders;
+    for (int i = 0; i < streams; ++i) {
+        senders.emplace_back([&clients, &failure, i, per_stream, chunk]() {
+            try {
+                std::vector<char> buffer(chunk, 'x');
+                long long remaining = per_stream;
+                while (remaining > 0) {
+                    int length = static_cast<int>(std::min<long long>(remaining, chunk));
+                    clients[i].SendAll(buffer.data(), length);
+                    remaining -= length;
+                }
+                ::shutdown(clients[i].GetDescriptor(), SD_SEND);
+            } catch (DWORD error) {
+                // The receiver on the other end waits for EOF; closing ends it.
+                SetFailure(failure, error);
+                CloseQuietly(clients[i]);
+            }
+        });
+    }
+    for (std::thread& sender : senders)
+        sender.join();
+    for (std::thread& receiver : receivers)
+        receiver.join();
+    double elapsed = Now() - start;
+    if (failure != 0)
+        throw failure.load();
+
+    printf("{\"benchmark\":\"tcp_throughput\",\"streams\":%d,\"chunk\":%d,\"bytes\":%lld,"
+           "\"seconds\":%.4f,\"mbytes_per_second\":%.2f}\n",
+           streams, chunk, received.load(), elapsed, received.load() / elapsed / 1e6);
+}
+
+//----------------------------
+//  TCP connection rate
+//----------------------------
+
+static void TcpConnectionRate(double duration) {
+    TCPListenSocket<AF_INET> listener;
+    listener.Bind(TEXT("127.0.0.1"), 0);
+    listener.Listen(SOMAXCONN);
+    u_short port = LocalPort(listener);
+
+    std::atomic<bool> stopped(false);
+    std::atomic<DWORD> failure(0);
+    std::thread server([&]() {
+        while (!stopped) {
+            Result<TCPCommunicateSocket<AF_INET>> peer = listener.TryAccept();
+            if (!peer) {
+                // Closing the listener is how the benchmark stops the server.
+                if (!stopped)
+                    SetFailure(failure, peer.GetError());
+                break;
+            }
+        }
+    });
+
+    long long connections = 0;
+    double start = Now();
+    double elapsed = 0;
+    try {
+        while (elapsed < duration && failure == 0) {
+            TCPCommunicateSocket<AF_INET> client;
+            client.SetLinger(true, 0);
+            client.Connect(Loopback(port));
+            client.Close();
+            ++connections;
+            elapsed = Now() - start;
+        }
+    } catch (DWORD error) {
+        SetFailure(failure, error);
+    }
+    stopped = true;
+    CloseQuietly(listener);
+    server.join();
+    if (failure != 0)
+        throw failure.load();
+
+    printf("{\"benchmark\":\"tcp_connection_rate\",\"connections\":%lld,\"seconds\":%.4f,"
+           "\"connections_per_second\":%.2f}\n",
+           connections, elapsed, connections / elapsed);
+}
+
+//----------------------------
+//  UDP packets per second
+//----------------------------
+
+static void UdpPacketRate(int payload, int packets) {
+    UDPSocket<AF_INET> receiver;
+    receiver.SetOption<Option::ReceiveBuffer>(8 * 1024 * 1024);
+    receiver.SetOption<Option::ReceiveTimeout>(200);
+    receiver.Bind(TEXT("127.0.0.1"), 0);
+    SocketAddr<AF_INET> to = Loopback(LocalPort(receiver));
+
+    long long received = 0;
+    double first = 0;
+    double last = 0;
+    std::thread reader([&]() {
+        std::vector<char> buffer(65536);
+        for (;;) {
+            Result<UDPSocket<AF_INET>::ReceiveInfo> info = receiver.TryReceiveFrom(buffer.data(), 65536);
+            if (!info)
+                break;
+            last = Now();
+            if (received++ == 0)
+                first = last;
+        }
+    });
+
+    UDPSocket<AF_INET> sender;
+    std::vector<char> buffer(payload, 'x');
+    double start = Now();
+    for (int i = 0; i < packets; ++i)
+        sender.TrySendTo(buffer.data(), payload, to);
+    double send_elapsed = Now() - start;
+    reader.join();
+
+    double receive_elapsed = last > first ? last - first : 0;
+    printf("{\"benchmark\":\"udp_packet_rate\",\"payload\":%d,\"sent\":%d,\"received\":%lld,"
+           "\"send_pps\":%.2f,\"receive_pps\":%.2f}\n",
+           payload, packets, received,
+           packets / send_elapsed, receive_elapsed > 0 ? received / receive_elapsed : 0.0);
+}
+
+//----------------------------
+//  Runtime scaling
+//----------------------------
+
+static void RuntimeScaling(int workers, int connections_per_client, double duration) {
+    Runtime<AF_INET> runtime(workers);
+    u_short port = LocalPort(runtime.Listen(TEXT("127.0.0.1"), 0, SOMAXCONN));
+    runtime.Start([](Runtime<AF_INET>::Worker& worker, TCPCommunicateSocket<AF_INET> socket) {
+        socket.SetOption<Option::NoDelay>(TRUE);
+        worker.Adopt(std::move(socket), ReactorRead,
+            [](Runtime<AF_INET>::Worker& owner, const TCPCommunicateSocket<AF_INET>& peer, SHORT) {
+                char buffer[4096];
+                Result<int> length = peer.TryReceive(buffer, sizeof(buffer));
+                if (length.WouldBlock())
+                    return;
+                if (!length || length.Value() == 0) {
+                    owner.Drop(peer.GetDescriptor());
+                    return;
+                }
+                peer.SendAll(buffer, length.Value());
+            });
+    });
+
+    const int payload = 64;
+    std::atomic<long long> requests(0);
+    std::atomic<DWORD> failure(0);
+    std::vector<std::thread> clients;
+    double start = Now();
+    for (int i = 0; i < workers; ++i) {
+        clients.emplace_back([&requests, &failure, port, connections_per_client, duration, start]() {
+            try {
+                // A receive timeout keeps a client from waiting forever on a
+                // runtime that stopped after a failure.
+                std::vector<TCPCommunicateSocket<AF_INET>> connections(connections_per_client);
+                for (TCPCommunicateSocket<AF_INET>& connection : connections) {
+                    connection.SetOption<Option::NoDelay>(TRUE);
+                    connection.SetOption<Option::ReceiveTimeout>(5000);
+                    connection.Connect(Loopback(port));
+                }
+
+                char buffer[payload] = { };
+                long long completed = 0;
+                while (Now() - start < duration && failure == 0) {
+                    for (TCPCommunicateSocket<AF_INET>& connection : connections)
+                        connection.SendAll(buffer, payload);
+                    for (TCPCommunicateSocket<AF_INET>& connection : connections)
+                        connection.ReceiveExact(buffer, payload);
+                    completed += connections_per_client;
+                }
+                requests += completed;
+            } catch (DWORD error) {
+                SetFailure(failure, error);
+            }
+        });
+    }
+    for (std::thread& client : clients)
+        client.join();
+    double elapsed = Now() - start;
+    runtime.Stop();
+    if (failure != 0)
+        throw failure.load();
+
+    printf("{\"benchmark\":\"runtime_scaling\",\"workers\":%d,\"connections\":%d,\"requests\":%lld,"
+           "\"seconds\":%.4f,\"requests_per_second\":%.2f}\n",
+           workers, workers * connections_per_client, requests.load(), elapsed, requests.load() / elapsed);
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    bool quick = argc > 1 && _tcscmp(argv[1], TEXT("--quick")) == 0;
+    int scale = quick ? 10 : 1;
+
+    WSADATA data;
+    if (::WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return 1;
+
+    try {
+        const int payloads[] = { 64, 512, 4096 };
+        for (int payload : payloads)
+            TcpPingPong<KernelTransport<AF_INET>>("kernel", payload, 100000 / scale);
+        for (int payload : payloads)
+            TcpPingPong<MemoryTransport<AF_INET>>("memory", payload, 100000 / scale);
+
+        const int streams[] = { 1, 2, 4, 8 };
+        for (int count : streams)
+            TcpThroughput(count, 4LL * 1024 * 1024 * 1024 / scale, 64 * 1024);
+
+        TcpConnectionRate(quick ? 0.5 : 3.0);
+
+        const int datagrams[] = { 64, 512, 1400 };
+        for (int payload : datagrams)
+            UdpPacketRate(payload, 1000000 / scale);
+
+        const int workers[] = { 1, 2, 4, 8, 16 };
+        for (int count : workers)
+            RuntimeScaling(count, 16, quick ? 0.5 : 3.0);
+    } catch (DWORD error) {
+        fprintf(stderr, "benchmark failed with error %lu\n", error);
+        ::WSACleanup();
+        return 1;
+    }
+
+    ::WSACleanup();
+    return 0;
+}
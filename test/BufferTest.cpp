@@ -0,0 +1,102 @@
+// Regression tests for tinySocket::BufferPool and MirroredRingBuffer.
+// Build: cl /EHsc /I.. BufferTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/Buffer.hpp"
+#include "../tinySocket/TCPSocket.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <cstring>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+//----------------------------
+//  Size classes and block reuse
+//----------------------------
+
+static void PoolRoundsAndReuses() {
+    CHECK(BufferPool::RoundUp(1) == BufferPool::MinimumSize);
+    CHECK(BufferPool::RoundUp(BufferPool::MinimumSize + 1) == 2 * BufferPool::MinimumSize);
+    CHECK(BufferPool::RoundUp(BufferPool::MaximumSize + 1) == BufferPool::MaximumSize + 1);
+
+    void* first = BufferPool::Allocate(1000);
+    BufferPool::Free(first, 1000);
+    void* second = BufferPool::Allocate(1000);
+    CHECK(second == first);
+    BufferPool::Free(second, 1000);
+
+    PooledBuffer buffer(100);
+    CHECK(buffer.GetCapacity() == BufferPool::MinimumSize);
+    PooledBuffer moved(std::move(buffer));
+    CHECK(buffer.GetData() == nullptr);
+    CHECK(moved.GetData() != nullptr);
+}
+
+//----------------------------
+//  Reads and writes across the end of the ring stay contiguous
+//----------------------------
+
+static void RingWrapsContiguously() {
+    MirroredRingBuffer ring(1);
+    size_t capacity = ring.GetCapacity();
+    CHECK(capacity > 0);
+    CHECK(ring.GetWritableSize() == capacity);
+
+    ring.Commit(capacity - 4);
+    ring.Consume(capacity - 4);
+    CHECK(ring.GetReadableSize() == 0);
+
+    const char message[] = "across the seam";
+    memcpy(ring.GetWritePointer(), message, sizeof(message));
+    ring.Commit(sizeof(message));
+    CHECK(ring.GetReadableSize() == sizeof(message));
+    CHECK(memcmp(ring.GetReadPointer(), message, sizeof(message)) == 0);
+
+    ring.Consume(sizeof(message));
+    CHECK(ring.GetReadableSize() == 0);
+    CHECK(ring.GetWritableSize() == capacity);
+}
+
+//----------------------------
+//  A full ring fails Receive instead of reporting end of stream
+//----------------------------
+
+static void FullRingFailsReceive() {
+    MirroredRingBuffer ring(1);
+    TCPCommunicateSocket<AF_INET> socket;
+    ring.Commit(ring.GetCapacity());
+    CHECK(ring.GetWritableSize() == 0);
+
+    Result<int> received = ring.Receive(socket);
+    CHECK(!received);
+    CHECK(received.GetError() == WSAENOBUFS);
+}
+
+int _tmain() {
+    WSADATA data;
+    if (::WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return 1;
+
+    try {
+        PoolRoundsAndReuses();
+        RingWrapsContiguously();
+        FullRingFailsReceive();
+    } catch (DWORD error) {
+        fprintf(stderr, "test failed with error %lu\n", error);
+        ++failures;
+    }
+
+    ::WSACleanup();
+    if (failures == 0)
+        printf("BufferTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// Regression tests for the framing codecs, FrameReader and FrameWriter.
+// Build: cl /EHsc /I.. FramingTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/Framing.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+template<typename _Codec>
+static std::string Encode(FrameWriter<_Codec>& writer) {
+    std::string wire;
+    WSABUF* buffers = writer.GetBuffers();
+    for (size_t i = 0; i < writer.GetPendingCount(); ++i)
+        wire.append(buffers[i].buf, buffers[i].len);
+    writer.Clear();
+    return wire;
+}
+
+template<typename _Codec>
+static std::vector<std::string> Decode(FrameReader<_Codec>& reader, const std::string& wire) {
+    MirroredRingBuffer& buffer = reader.GetBuffer();
+    memcpy(buffer.GetWritePointer(), wire.data(), wire.size());
+    buffer.Commit(wire.size());
+
+    std::vector<std::string> frames;
+    reader.Parse([&](const char* data, size_t length) { frames.push_back(std::string(data, length)); });
+    return frames;
+}
+
+template<typename _Codec>
+static void RoundTrip() {
+    FrameWriter<_Codec> writer;
+    writer.Add("alpha", 5);
+    writer.Add("", 0);
+    writer.Add("gamma", 5);
+    std::string wire = Encode(writer);
+
+    FrameReader<_Codec> reader;
+    std::vector<std::string> frames = Decode(reader, wire.substr(0, wire.size() - 1));
+    CHECK(frames.size() == 2);
+    if (frames.size() == 2) {
+        CHECK(frames[0] == "alpha");
+        CHECK(frames[1] == "");
+    }
+
+    frames = Decode(reader, wire.substr(wire.size() - 1));
+    CHECK(frames.size() == 1);
+    if (frames.size() == 1)
+        CHECK(frames[0] == "gamma");
+    CHECK(reader.GetBuffer().GetReadableSize() == 0);
+}
+
+//----------------------------
+//  Round trips, delivered in two pieces
+//----------------------------
+
+static void CodecsRoundTrip() {
+    RoundTrip<LengthPrefixCodec<2>>();
+    RoundTrip<LengthPrefixCodec<4>>();
+    RoundTrip<VarintCodec>();
+    RoundTrip<DelimiterCodec<'\n'>>();
+}
+
+//----------------------------
+//  Varint header encoding and limits
+//----------------------------
+
+static void VarintHeaders() {
+    char header[VarintCodec::MaxHeader];
+    CHECK(VarintCodec::EncodeHeader(header, 300) == 2);
+    CHECK(static_cast<unsigned char>(header[0]) == 0xac);
+    CHECK(static_cast<unsigned char>(header[1]) == 0x02);
+
+    size_t offset = 0;
+    size_t length = 0;
+    size_t consumed = 0;
+    CHECK(!VarintCodec::Decode(header, 1, offset, length, consumed));
+
+    char overlong[VarintCodec::MaxHeader + 1];
+    memset(overlong, 0x80, sizeof(overlong));
+    try {
+        VarintCodec::Decode(overlong, sizeof(overlong), offset, length, consumed);
+        CHECK(!"an overlong varint header was accepted");
+    } catch (DWORD error) {
+        CHECK(error == WSAEMSGSIZE);
+    }
+}
+
+//----------------------------
+//  Payloads the codec cannot carry are rejected by Add
+//----------------------------
+
+static void WriterRejectsUnframeable() {
+    FrameWriter<LengthPrefixCodec<1>> short_prefix;
+    std::vector<char> payload(256);
+    try {
+        short_prefix.Add(payload.data(), payload.size());
+        CHECK(!"a payload longer than the length prefix was accepted");
+    } catch (DWORD error) {
+        CHECK(error == WSAEMSGSIZE);
+    }
+    CHECK(short_prefix.GetPendingCount() == 0);
+
+    FrameWriter<DelimiterCodec<'\n'>> lines;
+    try {
+        lines.Add("two\nlines", 9);
+        CHECK(!"a payload containing the delimiter was accepted");
+    } catch (DWORD error) {
+        CHECK(error == WSAEINVAL);
+    }
+    CHECK(lines.GetPendingCount() == 0);
+}
+
+int _tmain() {
+    try {
+        CodecsRoundTrip();
+        VarintHeaders();
+        WriterRejectsUnframeable();
+    } catch (DWORD error) {
+        fprintf(stderr, "test failed with error %lu\n", error);
+        ++failures;
+    }
+
+    if (failures == 0)
+        printf("FramingTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
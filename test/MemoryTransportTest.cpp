@@ -0,0 +1,182 @@
+// Regression tests for the in-memory transport.
+// Build: cl /EHsc /I.. MemoryTransportTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/MemoryTransport.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <vector>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+static void Connect(MemoryListenSocket<AF_INET>& listener, MemoryCommunicateSocket<AF_INET>& client,
+                    MemoryCommunicateSocket<AF_INET>& server) {
+    listener.Bind(TEXT("127.0.0.1"), 0);
+    listener.Listen(4);
+    client.Connect(listener.GetSocketName());
+    server = listener.Accept();
+}
+
+//----------------------------
+//  Stream round trip in both directions
+//----------------------------
+
+static void StreamRoundTrip() {
+    MemoryNetwork<AF_INET> network;
+    MemoryListenSocket<AF_INET> listener(network);
+    MemoryCommunicateSocket<AF_INET> client(network);
+    MemoryCommunicateSocket<AF_INET> server(network);
+    Connect(listener, client, server);
+
+    char buffer[16] = { };
+    CHECK(client.SendAll("request", 7) == 7);
+    CHECK(server.ReceiveExact(buffer, 7) == 7);
+    CHECK(memcmp(buffer, "request", 7) == 0);
+
+    CHECK(server.SendAll("response", 8) == 8);
+    CHECK(client.ReceiveExact(buffer, 8) == 8);
+    CHECK(memcmp(buffer, "response", 8) == 0);
+}
+
+//----------------------------
+//  Records and payloads that straddle the end of the ring
+//----------------------------
+
+static void StreamWrapAround() {
+    MemoryNetwork<AF_INET> network(64);
+    MemoryListenSocket<AF_INET> listener(network);
+    MemoryCommunicateSocket<AF_INET> client(network);
+    MemoryCommunicateSocket<AF_INET> server(network);
+    Connect(listener, client, server);
+
+    char sent[40];
+    char received[40];
+    for (int round = 0; round < 16; ++round) {
+        for (size_t i = 0; i < sizeof(sent); ++i)
+            sent[i] = static_cast<char>(round * 7 + i);
+        CHECK(client.SendAll(sent, sizeof(sent)) == sizeof(sent));
+        CHECK(server.ReceiveExact(received, sizeof(received)) == sizeof(received));
+        CHECK(memcmp(sent, received, sizeof(sent)) == 0);
+    }
+}
+
+//----------------------------
+//  Orderly close and reset
+//----------------------------
+
+static void StreamEofAndReset() {
+    MemoryNetwork<AF_INET> network;
+    MemoryListenSocket<AF_INET> listener(network);
+    MemoryCommunicateSocket<AF_INET> client(network);
+    MemoryCommunicateSocket<AF_INET> server(network);
+    Connect(listener, client, server);
+
+    char buffer[8];
+    client.SendAll("last", 4);
+    client.Close();
+    CHECK(server.ReceiveExact(buffer, 4) == 4);
+    CHECK(server.Receive(buffer, sizeof(buffer)) == 0);
+
+    MemoryCommunicateSocket<AF_INET> peer(network);
+    peer.Connect(listener.GetSocketName());
+    MemoryCommunicateSocket<AF_INET> accepted = listener.Accept();
+    accepted.Close();
+    Result<int> sent = peer.TrySend("lost", 4);
+    CHECK(!sent);
+    CHECK(sent.GetError() == WSAECONNRESET);
+
+    listener.Close();
+    MemoryCommunicateSocket<AF_INET> refused(network);
+    try {
+        refused.Connect(listener.GetSocketName());
+        CHECK(!"connect to a closed listener succeeded");
+    } catch (DWORD error) {
+        CHECK(error == WSAECONNREFUSED);
+    }
+}
+
+//----------------------------
+//  The same seed drops the same datagrams
+//----------------------------
+
+static std::vector<int> DeliverWithLoss(ULONGLONG seed) {
+    MemoryNetwork<AF_INET> network;
+    MemoryUDPSocket<AF_INET> receiver(network);
+    MemoryUDPSocket<AF_INET> sender(network);
+    receiver.Bind(TEXT("127.0.0.1"), 0);
+    receiver.SetNonBlocking(true);
+    LinkProfile profile = { 0, 0, 0.5 };
+    sender.SetLinkProfile(profile, seed);
+
+    for (int i = 0; i < 64; ++i)
+        CHECK(sender.SendTo(&i, sizeof(i), receiver.GetSocketName()) == sizeof(i));
+
+    std::vector<int> delivered;
+    int value = 0;
+    while (Result<MemoryUDPSocket<AF_INET>::ReceiveInfo> received = receiver.TryReceiveFrom(&value, sizeof(value)))
+        delivered.push_back(value);
+    return delivered;
+}
+
+static void LossIsDeterministic() {
+    std::vector<int> first = DeliverWithLoss(42);
+    std::vector<int> second = DeliverWithLoss(42);
+    CHECK(!first.empty());
+    CHECK(first.size() < 64);
+    CHECK(first == second);
+}
+
+//----------------------------
+//  Datagrams that do not fit
+//----------------------------
+
+static void OversizeDatagram() {
+    MemoryNetwork<AF_INET> network(64);
+    MemoryUDPSocket<AF_INET> receiver(network);
+    MemoryUDPSocket<AF_INET> sender(network);
+    receiver.Bind(TEXT("127.0.0.1"), 0);
+    receiver.SetNonBlocking(true);
+
+    char payload[100] = { };
+    Result<int> sent = sender.TrySendTo(payload, sizeof(payload), receiver.GetSocketName());
+    CHECK(!sent);
+    CHECK(sent.GetError() == WSAEMSGSIZE);
+
+    CHECK(sender.SendTo(payload, 20, receiver.GetSocketName()) == 20);
+    char small[8];
+    Result<MemoryUDPSocket<AF_INET>::ReceiveInfo> truncated = receiver.TryReceiveFrom(small, sizeof(small));
+    CHECK(!truncated);
+    CHECK(truncated.GetError() == WSAEMSGSIZE);
+    CHECK(receiver.TryReceiveFrom(small, sizeof(small)).WouldBlock());
+}
+
+int _tmain() {
+    WSADATA data;
+    if (::WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return 1;
+
+    try {
+        StreamRoundTrip();
+        StreamWrapAround();
+        StreamEofAndReset();
+        LossIsDeterministic();
+        OversizeDatagram();
+    } catch (DWORD error) {
+        fprintf(stderr, "test failed with error %lu\n", error);
+        ++failures;
+    }
+
+    ::WSACleanup();
+    if (failures == 0)
+        printf("MemoryTransportTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
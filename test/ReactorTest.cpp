@@ -0,0 +1,107 @@
+// Regression tests for tinySocket::Reactor.
+// Build: cl /EHsc /I.. ReactorTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/Reactor.hpp"
+#include "../tinySocket/UDPSocket.hpp"
+#include <tchar.h>
+#include <cstdio>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+static void MakeReadable(const UDPSocket<AF_INET>& socket) {
+    UDPSocket<AF_INET> sender;
+    char signal = 0;
+    sender.SendTo(&signal, 1, socket.GetSocketName());
+}
+
+//----------------------------
+//  Register, remove and re-register outside dispatch
+//----------------------------
+
+static void ReregisterAfterRemove() {
+    Reactor reactor;
+    UDPSocket<AF_INET> first;
+    UDPSocket<AF_INET> second;
+    first.Bind(TEXT("127.0.0.1"), 0);
+    second.Bind(TEXT("127.0.0.1"), 0);
+
+    reactor.Register(first, ReactorRead, [](SOCKET, SHORT) { });
+    reactor.Register(second, ReactorRead, [](SOCKET, SHORT) { });
+    reactor.Remove(first);
+    reactor.Remove(second);
+    CHECK(reactor.GetCount() == 0);
+
+    reactor.Register(second, ReactorRead, [](SOCKET, SHORT) { });
+    reactor.Register(first, ReactorRead, [](SOCKET, SHORT) { });
+    CHECK(reactor.GetCount() == 2);
+    CHECK(reactor.GetEvents(second.GetDescriptor()) == ReactorRead);
+    reactor.Modify(first, ReactorRead | ReactorWrite);
+    CHECK(reactor.GetEvents(first.GetDescriptor()) == (ReactorRead | ReactorWrite));
+}
+
+//----------------------------
+//  Remove every entry from inside a handler, then re-register
+//----------------------------
+
+static void ReregisterAfterRemoveDuringDispatch() {
+    Reactor reactor;
+    UDPSocket<AF_INET> first;
+    UDPSocket<AF_INET> second;
+    first.Bind(TEXT("127.0.0.1"), 0);
+    second.Bind(TEXT("127.0.0.1"), 0);
+
+    auto remove_both = [&](SOCKET, SHORT) {
+        if (reactor.GetCount() == 0)
+            return;
+        reactor.Remove(first);
+        reactor.Remove(second);
+    };
+    reactor.Register(first, ReactorRead, remove_both);
+    reactor.Register(second, ReactorRead, remove_both);
+    MakeReadable(first);
+    MakeReadable(second);
+    reactor.RunOnce(1000);
+    CHECK(reactor.GetCount() == 0);
+
+    bool dispatched = false;
+    try {
+        reactor.Register(second, ReactorRead, [&](SOCKET, SHORT) { dispatched = true; });
+        reactor.Register(first, ReactorRead, [](SOCKET, SHORT) { });
+    } catch (DWORD) {
+        CHECK(!"re-registering a removed descriptor threw");
+        return;
+    }
+    CHECK(reactor.GetCount() == 2);
+    CHECK(reactor.GetEvents(second.GetDescriptor()) == ReactorRead);
+    reactor.RunOnce(1000);
+    CHECK(dispatched);
+}
+
+int _tmain() {
+    WSADATA data;
+    if (::WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return 1;
+
+    try {
+        ReregisterAfterRemove();
+        ReregisterAfterRemoveDuringDispatch();
+    } catch (DWORD error) {
+        fprintf(stderr, "test failed with error %lu\n", error);
+        ++failures;
+    }
+
+    ::WSACleanup();
+    if (failures == 0)
+        printf("ReactorTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Regression tests for the tinySocket::Resolver cache.
+// Build: cl /EHsc /I.. ResolverTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/Resolver.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <future>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+typedef Resolver<AF_INET> Resolver4;
+
+// Answers every name with 192.0.2.1 and counts how often it was asked.
+static Resolver4::Lookup CountingLookup(int& calls) {
+    return [&calls](const TCHAR*, Resolver4::AddressList& addresses) -> DWORD {
+        ++calls;
+        addresses.push_back(SocketAddr<AF_INET>(TEXT("192.0.2.1"), 0));
+        return 0;
+    };
+}
+
+//----------------------------
+//  Hits are served from the cache with the requested port
+//----------------------------
+
+static void CachesLookups() {
+    int calls = 0;
+    Resolver4 resolver(std::chrono::seconds(60), 1, CountingLookup(calls));
+
+    Resolver4::AddressList first = resolver.Resolve(TEXT("example.test"), 80);
+    Resolver4::AddressList second = resolver.Resolve(TEXT("example.test"), 443);
+    CHECK(calls == 1);
+    CHECK(first.size() == 1 && second.size() == 1);
+    CHECK(ntohs(first.front().sin_port) == 80);
+    CHECK(ntohs(second.front().sin_port) == 443);
+    CHECK(ntohs(resolver.ResolveOne(TEXT("example.test"), 8080).sin_port) == 8080);
+    CHECK(calls == 1);
+
+    Resolver4::AddressList cached;
+    CHECK(resolver.TryResolveCached(TEXT("example.test"), 22, cached));
+    CHECK(!resolver.TryResolveCached(TEXT("other.test"), 22, cached));
+
+    resolver.Invalidate(TEXT("example.test"));
+    resolver.Resolve(TEXT("example.test"), 80);
+    CHECK(calls == 2);
+}
+
+//----------------------------
+//  Expired entries are looked up again
+//----------------------------
+
+static void ExpiresEntries() {
+    int calls = 0;
+    Resolver4 resolver(std::chrono::milliseconds(0), 1, CountingLookup(calls));
+    resolver.Resolve(TEXT("example.test"), 80);
+    resolver.Resolve(TEXT("example.test"), 80);
+    CHECK(calls == 2);
+}
+
+//----------------------------
+//  Fixed hosts never expire and ignore Invalidate
+//----------------------------
+
+static void FixedHosts() {
+    int calls = 0;
+    Resolver4 resolver(std::chrono::milliseconds(0), 1, CountingLookup(calls));
+    resolver.AddHost(TEXT("fixed.test"), SocketAddr<AF_INET>(TEXT("198.51.100.7"), 0));
+    resolver.Invalidate(TEXT("fixed.test"));
+
+    SocketAddr<AF_INET> address = resolver.ResolveOne(TEXT("fixed.test"), 25);
+    CHECK(calls == 0);
+    CHECK(ntohs(address.sin_port) == 25);
+    CHECK(address.sin_addr.s_addr == SocketAddr<AF_INET>(TEXT("198.51.100.7"), 0).sin_addr.s_addr);
+}
+
+//----------------------------
+//  Lookup failures are reported and not cached
+//----------------------------
+
+static void ReportsFailures() {
+    Resolver4 failing(std::chrono::seconds(60), 1, [](const TCHAR*, Resolver4::AddressList&) -> DWORD {
+        return WSANO_DATA;
+    });
+    try {
+        failing.Resolve(TEXT("missing.test"), 80);
+        CHECK(!"a failed lookup resolved");
+    } catch (DWORD error) {
+        CHECK(error == WSANO_DATA);
+    }
+
+    Resolver4 empty(std::chrono::seconds(60), 1, [](const TCHAR*, Resolver4::AddressList&) -> DWORD {
+        return 0;
+    });
+    try {
+        empty.Resolve(TEXT("empty.test"), 80);
+        CHECK(!"an empty lookup resolved");
+    } catch (DWORD error) {
+        CHECK(error == WSAHOST_NOT_FOUND);
+    }
+    Resolver4::AddressList cached;
+    CHECK(!empty.TryResolveCached(TEXT("empty.test"), 80, cached));
+}
+
+//----------------------------
+//  Asynchronous resolution through the worker
+//----------------------------
+
+static void ResolvesAsynchronously() {
+    int calls = 0;
+    Resolver4 resolver(std::chrono::seconds(60), 1, CountingLookup(calls));
+
+    std::promise<u_short> miss;
+    resolver.ResolveAsync(TEXT("example.test"), 80, [&miss](DWORD status, const Resolver4::AddressList& addresses) {
+        miss.set_value(status == 0 && addresses.size() == 1 ? ntohs(addresses.front().sin_port) : 0);
+    });
+    CHECK(miss.get_future().get() == 80);
+
+    bool hit = false;
+    resolver.ResolveAsync(TEXT("example.test"), 443, [&hit](DWORD status, const Resolver4::AddressList& addresses) {
+        hit = status == 0 && addresses.size() == 1 && ntohs(addresses.front().sin_port) == 443;
+    });
+    CHECK(hit);
+    CHECK(calls == 1);
+}
+
+int _tmain() {
+    WSADATA data;
+    if (::WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return 1;
+
+    try {
+        CachesLookups();
+        ExpiresEntries();
+        FixedHosts();
+        ReportsFailures();
+        ResolvesAsynchronously();
+    } catch (DWORD error) {
+        fprintf(stderr, "test failed with error %lu\n", error);
+        ++failures;
+    }
+
+    ::WSACleanup();
+    if (failures == 0)
+        printf("ResolverTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
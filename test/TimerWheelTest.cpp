@@ -0,0 +1,126 @@
+// Regression tests for tinySocket::TimerWheel.
+// Build: cl /EHsc /I.. TimerWheelTest.cpp
+// Exits with a non-zero status if any check fails.
+#include "../tinySocket/TimerWheel.hpp"
+#include <tchar.h>
+#include <cstdio>
+#include <memory>
+
+using namespace tinySocket;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expression); \
+            ++failures; \
+        } \
+    } while (0)
+
+//----------------------------
+//  Fire at expiry, across a cascade
+//----------------------------
+
+static void FireAtExpiry() {
+    ULONGLONG start = ::GetTickCount64();
+    TimerWheel wheel;
+    int near_fired = 0;
+    int far_fired = 0;
+    Timer near_timer([&]() { ++near_fired; });
+    Timer far_timer([&]() { ++far_fired; });
+    wheel.Schedule(near_timer, 10);
+    wheel.Schedule(far_timer, TimerWheel::SlotCount + 44);
+    CHECK(wheel.GetCount() == 2);
+
+    wheel.Advance(start + 9);
+    CHECK(near_fired == 0);
+    CHECK(near_timer.IsPending());
+
+    wheel.Advance(start + 1000);
+    CHECK(near_fired == 1);
+    CHECK(far_fired == 1);
+    CHECK(!near_timer.IsPending());
+    CHECK(!far_timer.IsPending());
+    CHECK(wheel.GetCount() == 0);
+}
+
+//----------------------------
+//  Cancel, and cancel by destruction
+//----------------------------
+
+static void CancelBeforeExpiry() {
+    ULONGLONG start = ::GetTickCount64();
+    TimerWheel wheel;
+    bool fired = false;
+    Timer timer([&]() { fired = true; });
+    wheel.Schedule(timer, 10);
+    timer.Cancel();
+    CHECK(wheel.GetCount() == 0);
+
+    {
+        Timer scoped([&]() { fired = true; });
+        wheel.Schedule(scoped, 10);
+        CHECK(wheel.GetCount() == 1);
+    }
+    CHECK(wheel.GetCount() == 0);
+
+    wheel.Advance(start + 1000);
+    CHECK(!fired);
+}
+
+//----------------------------
+//  A callback that destroys its own timer
+//----------------------------
+
+static void CallbackDestroysTimer() {
+    ULONGLONG start = ::GetTickCount64();
+    TimerWheel wheel;
+    bool fired = false;
+    std::unique_ptr<Timer> timer;
+    timer.reset(new Timer([&]() {
+        timer.reset();
+        fired = true;
+    }));
+    wheel.Schedule(*timer, 10);
+
+    wheel.Advance(start + 1000);
+    CHECK(fired);
+    CHECK(timer == nullptr);
+    CHECK(wheel.GetCount() == 0);
+}
+
+//----------------------------
+//  A callback that re-arms its own timer
+//----------------------------
+
+static void CallbackReschedulesTimer() {
+    ULONGLONG start = ::GetTickCount64();
+    TimerWheel wheel;
+    int fired = 0;
+    Timer timer;
+    timer.SetCallback([&]() {
+        if (++fired < 3)
+            wheel.Schedule(timer, 10);
+    });
+    wheel.Schedule(timer, 10);
+
+    wheel.Advance(start + 1000);
+    CHECK(fired == 3);
+    CHECK(wheel.GetCount() == 0);
+
+    wheel.Schedule(timer, 10);
+    wheel.Advance(start + 2000);
+    CHECK(fired == 4);
+}
+
+int _tmain() {
+    FireAtExpiry();
+    CancelBeforeExpiry();
+    CallbackDestroysTimer();
+    CallbackReschedulesTimer();
+
+    if (failures == 0)
+        printf("TimerWheelTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include <new>
+#include <mutex>
+#include <climits>
+
+#pragma comment(lib, "onecore.lib")
+
+namespace tinySocket {
+
+    class BufferPool {
+    public:
+
+        static const size_t MinimumSize = 512;
+        static const size_t ClassCount = 8;
+        static const size_t MaximumSize = MinimumSize << (ClassCount - 1);
+        static const size_t ThreadCacheLimit = 64;
+
+    private:
+
+        struct Block {
+            Block* next;
+        };
+
+        struct FreeList {
+            Block* head;
+            size_t count;
+        };
+
+        struct Shared {
+            std::mutex mutex;
+            FreeList lists[ClassCount];
+        };
+
+        struct ThreadCache {
+            FreeList lists[ClassCount];
+
+            ~ThreadCache() {
+                for (size_t i = 0; i < ClassCount; ++i)
+                    Drain(i, lists[i], lists[i].count);
+            }
+        };
+
+        static Shared& GetShared() {
+            static Shared shared = { };
+            return shared;
+        }
+
+        static ThreadCache& GetThreadCache() {
+            thread_local ThreadCache cache = { };
+            return cache;
+        }
+
+        static void Drain(size_t index, FreeList& list, size_t count) {
+            if (count == 0)
+                return;
+
+            Block* first = list.head;
+            Block* last = first;
+            for (size_t i = 1; i < count; ++i)
+                last = last->next;
+            list.head = last->next;
+            list.count -= count;
+
+            Shared& shared = GetShared();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            last->next = shared.lists[index].head;
+            shared.lists[index].head = first;
+            shared.lists[index].count += count;
+        }
+
+        static size_t IndexOf(size_t capacity) {
+            size_t index = 0;
+            while ((MinimumSize << index) < capacity)
+                ++index;
+            return index;
+        }
+
+    public:
+
+        static size_t RoundUp(size_t size) {
+            if (size > MaximumSize)
+                return size;
+            return MinimumSize << IndexOf(size);
+        }
+
+        static void* Allocate(size_t capacity) {
+            if (capacity > MaximumSize)
+                return ::operator new(capacity);
+
+            size_t index = IndexOf(capacity);
+            FreeList& local = GetThreadCache().lists[index];
+            if (local.head == nullptr) {
+                Shared& shared = GetShared();
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                FreeList& global = shared.lists[index];
+                while (global.head != nullptr && local.count < ThreadCacheLimit / 2) {
+                    Block* block = global.head;
+                    global.head = block->next;
+                    --global.count;
+                    block->next = local.head;
+                    local.head = block;
+                    ++local.count;
+                }
+            }
+
+            if (local.head == nullptr)
+                return ::operator new(MinimumSize << index);
+
+            Block* block = local.head;
+            local.head = block->next;
+            --local.count;
+            return block;
+        }
+
+        static void Free(void* buffer, size_t capacity) {
+            if (buffer == nullptr)
+                return;
+            if (capacity > MaximumSize) {
+                ::operator delete(buffer);
+                return;
+            }
+
+            size_t index = IndexOf(capacity);
+            FreeList& local = GetThreadCache().lists[index];
+            Block* block = static_cast<Block*>(buffer);
+            block->next = local.head;
+            local.head = block;
+            ++local.count;
+            if (local.count > ThreadCacheLimit)
+                Drain(index, local, ThreadCacheLimit / 2);
+        }
+
+    };
+
+    class PooledBuffer {
+    private:
+        char* _data;
+        size_t _capacity;
+
+    public:
+
+        PooledBuffer() : _data(nullptr), _capacity(0) { }
+
+        PooledBuffer(size_t size) : _capacity(BufferPool::RoundUp(size)) {
+            _data = static_cast<char*>(BufferPool::Allocate(_capacity));
+        }
+
+        PooledBuffer(const PooledBuffer&) = delete;
+
+        PooledBuffer(PooledBuffer&& other) : _data(other._data), _capacity(other._capacity) {
+            other._data = nullptr;
+            other._capacity = 0;
+        }
+
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+        PooledBuffer& operator=(PooledBuffer&& other) {
+            if (this != &other) {
+                Release();
+                _data = other._data;
+                _capacity = other._capacity;
+                other._data = nullptr;
+                other._capacity = 0;
+            }
+            return *this;
+        }
+
+        ~PooledBuffer() {
+            Release();
+        }
+
+        char* GetData() const {
+            return _data;
+        }
+
+        size_t GetCapacity() const {
+            return _capacity;
+        }
+
+        void Release() {
+            BufferPool::Free(_data, _capacity);
+            _data = nullptr;
+            _capacity = 0;
+        }
+
+    };
+
+    class MirroredRingBuffer {
+    private:
+        HANDLE _section;
+        char* _base;
+        size_t _size;
+        ULONGLONG _read;
+        ULONGLONG _write;
+
+        void Destroy() {
+            if (_base != nullptr) {
+                ::UnmapViewOfFile(_base);
+                ::UnmapViewOfFile(_base + _size);
+            }
+            if (_section != nullptr)
+                ::CloseHandle(_section);
+        }
+
+    public:
+
+        MirroredRingBuffer(size_t size) throw(DWORD) : _section(nullptr), _base(nullptr), _read(0), _write(0) {
+            SYSTEM_INFO info;
+            ::GetSystemInfo(&info);
+            size_t granularity = info.dwAllocationGranularity;
+            _size = (size + granularity - 1) / granularity * granularity;
+
+            char* placeholder = static_cast<char*>(::VirtualAlloc2(nullptr, nullptr, 2 * _size,
+                                                                   MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+                                                                   PAGE_NOACCESS, nullptr, 0));
+            if (placeholder == nullptr)
+                throw ::GetLastError();
+
+            if (!::VirtualFree(placeholder, _size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+                DWORD error = ::GetLastError();
+                ::VirtualFree(placeholder, 0, MEM_RELEASE);
+                throw error;
+            }
+
+            _section = ::CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                           static_cast<DWORD>(static_cast<ULONGLONG>(_size) >> 32),
+                                           static_cast<DWORD>(_size), nullptr);
+            if (_section == nullptr) {
+                DWORD error = ::GetLastError();
+                ::VirtualFree(placeholder, 0, MEM_RELEASE);
+                ::VirtualFree(placeholder + _size, 0, MEM_RELEASE);
+                throw error;
+            }
+
+            void* first = ::MapViewOfFile3(_section, nullptr, placeholder, 0, _size,
+                                           MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+            if (first == nullptr) {
+                DWORD error = ::GetLastError();
+                ::VirtualFree(placeholder, 0, MEM_RELEASE);
+                ::VirtualFree(placeholder + _size, 0, MEM_RELEASE);
+                ::CloseHandle(_section);
+                throw error;
+            }
+
+            void* second = ::MapViewOfFile3(_section, nullptr, placeholder + _size, 0, _size,
+                                            MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+            if (second == nullptr) {
+                DWORD error = ::GetLastError();
+                ::UnmapViewOfFile(first);
+                ::VirtualFree(placeholder + _size, 0, MEM_RELEASE);
+                ::CloseHandle(_section);
+                throw error;
+            }
+
+            _base = placeholder;
+        }
+
+        MirroredRingBuffer(const MirroredRingBuffer&) = delete;
+
+        MirroredRingBuffer(MirroredRingBuffer&& other) :
+            _section(other._section), _base(other._base), _size(other._size),
+            _read(other._read), _write(other._write) {
+            other._section = nullptr;
+            other._base = nullptr;
+        }
+
+        MirroredRingBuffer& operator=(const MirroredRingBuffer&) = delete;
+
+        ~MirroredRingBuffer() {
+            Destroy();
+        }
+
+        size_t GetCapacity() const {
+            return _size;
+        }
+
+        const char* GetReadPointer() const {
+            return _base + _read % _size;
+        }
+
+        size_t GetReadableSize() const {
+            return static_cast<size_t>(_write - _read);
+        }
+
+        void Consume(size_t length) {
+            _read += length;
+        }
+
+        char* GetWritePointer() const {
+            return _base + _write % _size;
+        }
+
+        size_t GetWritableSize() const {
+            return _size - GetReadableSize();
+        }
+
+        void Commit(size_t length) {
+            _write += length;
+        }
+
+        // Fails with WSAENOBUFS when the buffer is full, so a return of 0 always
+        // means the peer closed the connection.
+        template<int _AF>
+        Result<int> Receive(const TCPCommunicateSocket<_AF>& socket, int flag = 0) {
+            size_t writable = GetWritableSize();
+            if (writable == 0)
+                return Result<int>::Error(WSAENOBUFS);
+            if (writable > INT_MAX)
+                writable = INT_MAX;
+            Result<int> received = socket.TryReceive(GetWritePointer(), static_cast<int>(writable), flag);
+            if (received)
+                Commit(received.Value());
+            return received;
+        }
+
+    };
+
+}
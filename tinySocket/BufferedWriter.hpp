@@ -0,0 +1,168 @@
+#pragma once
+#include "Reactor.hpp"
+#include "Buffer.hpp"
+#include <deque>
+#include <cstring>
+
+namespace tinySocket {
+
+    template<int _AF>
+    class BufferedWriter {
+    public:
+
+        typedef std::function<void(bool)> WritableHandler;
+
+        static const size_t ChunkSize = 16 * 1024;
+        static const int MaxBuffers = 64;
+
+    private:
+
+        struct Chunk {
+            PooledBuffer buffer;
+            size_t begin;
+            size_t end;
+        };
+
+        Reactor& _reactor;
+        const TCPCommunicateSocket<_AF>& _socket;
+        std::deque<Chunk> _chunks;
+        size_t _pending;
+        size_t _flush_threshold;
+        size_t _low_watermark;
+        size_t _high_watermark;
+        bool _writable;
+        bool _waiting;
+        ULONGLONG _deferred;
+        WritableHandler _handler;
+
+        void Schedule() {
+            if (_deferred == 0 && !_waiting)
+                _deferred = _reactor.Defer([this]() { _deferred = 0; Flush(); });
+        }
+
+        void Consume(size_t length) {
+            _pending -= length;
+            while (length > 0) {
+                Chunk& chunk = _chunks.front();
+                size_t available = chunk.end - chunk.begin;
+                if (length < available) {
+                    chunk.begin += length;
+                    return;
+                }
+                length -= available;
+                _chunks.pop_front();
+            }
+        }
+
+        void SetWaiting(bool waiting) throw(DWORD) {
+            if (_waiting == waiting)
+                return;
+            SHORT events = _reactor.GetEvents(_socket.GetDescriptor());
+            _reactor.Modify(_socket.GetDescriptor(), static_cast<SHORT>(waiting ? events | ReactorWrite : events & ~ReactorWrite));
+            _waiting = waiting;
+        }
+
+        void UpdateWatermark() {
+            if (_writable && _pending >= _high_watermark) {
+                _writable = false;
+                if (_handler)
+                    _handler(false);
+            } else if (!_writable && _pending <= _low_watermark) {
+                _writable = true;
+                if (_handler)
+                    _handler(true);
+            }
+        }
+
+    public:
+
+        BufferedWriter(Reactor& reactor, const TCPCommunicateSocket<_AF>& socket,
+                       size_t low_watermark = 64 * 1024, size_t high_watermark = 256 * 1024,
+                       size_t flush_threshold = 64 * 1024) :
+            _reactor(reactor), _socket(socket), _pending(0), _flush_threshold(flush_threshold),
+            _low_watermark(low_watermark), _high_watermark(high_watermark),
+            _writable(true), _waiting(false), _deferred(0) { }
+
+        BufferedWriter(const BufferedWriter<_AF>&) = delete;
+
+        BufferedWriter<_AF>& operator=(const BufferedWriter<_AF>&) = delete;
+
+        ~BufferedWriter() {
+            if (_deferred != 0)
+                _reactor.CancelDeferred(_deferred);
+        }
+
+        void SetWritableHandler(WritableHandler handler) {
+            _handler = std::move(handler);
+        }
+
+        size_t GetPendingSize() const {
+            return _pending;
+        }
+
+        bool IsWritable() const {
+            return _writable;
+        }
+
+        bool Write(const void* buffer, size_t length) throw(DWORD) {
+            const char* data = reinterpret_cast<const char*>(buffer);
+            _pending += length;
+            while (length > 0) {
+                if (_chunks.empty() || _chunks.back().end == _chunks.back().buffer.GetCapacity())
+                    _chunks.push_back(Chunk { PooledBuffer(ChunkSize), 0, 0 });
+
+                Chunk& chunk = _chunks.back();
+                size_t copied = chunk.buffer.GetCapacity() - chunk.end;
+                if (copied > length)
+                    copied = length;
+                memcpy(chunk.buffer.GetData() + chunk.end, data, copied);
+                chunk.end += copied;
+                data += copied;
+                length -= copied;
+            }
+
+            if (_pending >= _flush_threshold && !_waiting)
+                Flush();
+            else
+                Schedule();
+            UpdateWatermark();
+            return _writable;
+        }
+
+        void Flush() throw(DWORD) {
+            if (_deferred != 0) {
+                _reactor.CancelDeferred(_deferred);
+                _deferred = 0;
+            }
+
+            while (_pending > 0) {
+                WSABUF buffers[MaxBuffers];
+                int count = 0;
+                for (auto it = _chunks.begin(); it != _chunks.end() && count < MaxBuffers; ++it, ++count) {
+                    buffers[count].buf = it->buffer.GetData() + it->begin;
+                    buffers[count].len = static_cast<ULONG>(it->end - it->begin);
+                }
+
+                Result<int> sent = _socket.TrySend(buffers, count);
+                if (sent.WouldBlock()) {
+                    SetWaiting(true);
+                    break;
+                }
+                if (!sent)
+                    throw sent.GetError();
+                Consume(static_cast<size_t>(sent.Value()));
+            }
+
+            if (_pending == 0)
+                SetWaiting(false);
+            UpdateWatermark();
+        }
+
+        void OnWritable() throw(DWORD) {
+            if (_waiting)
+                Flush();
+        }
+
+    };
+
+}
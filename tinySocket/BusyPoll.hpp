@@ -0,0 +1,123 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "UDPSocket.hpp"
+
+namespace tinySocket {
+
+    struct BusyPollPolicy {
+        ULONGLONG min_spin_us;
+        ULONGLONG max_spin_us;
+        INT park_timeout_ms;
+    };
+
+    struct BusyPollStats {
+        ULONGLONG spin_us;
+        ULONGLONG park_us;
+        ULONGLONG spin_hits;
+        ULONGLONG park_wakeups;
+    };
+
+    class BusyPoller {
+    private:
+        BusyPollPolicy _policy;
+        BusyPollStats _stats;
+        ULONGLONG _spin_us;
+        LONGLONG _frequency;
+        SOCKET _attached;
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Ensure(const Socket<_AF, _SocketType, _Protocol>& socket) throw(DWORD) {
+            if (socket.GetDescriptor() != _attached)
+                Attach(socket);
+        }
+
+        ULONGLONG Now() const {
+            LARGE_INTEGER counter;
+            ::QueryPerformanceCounter(&counter);
+            ULONGLONG ticks = static_cast<ULONGLONG>(counter.QuadPart);
+            ULONGLONG frequency = static_cast<ULONGLONG>(_frequency);
+            return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+        }
+
+        template<typename _Receive>
+        auto Poll(SOCKET descriptor, _Receive&& receive) throw(DWORD) -> decltype(receive()) {
+            ULONGLONG start = Now();
+            ULONGLONG now = start;
+            for (;;) {
+                auto result = receive();
+                if (!result.WouldBlock()) {
+                    _stats.spin_us += now - start;
+                    ++_stats.spin_hits;
+                    _spin_us = _spin_us * 2 > _policy.max_spin_us ? _policy.max_spin_us : _spin_us * 2;
+                    return result;
+                }
+                now = Now();
+                if (now - start >= _spin_us)
+                    break;
+                YieldProcessor();
+            }
+            _stats.spin_us += now - start;
+            _spin_us = _spin_us / 2 < _policy.min_spin_us ? _policy.min_spin_us : _spin_us / 2;
+
+            for (;;) {
+                WSAPOLLFD pollfd = { };
+                pollfd.fd = descriptor;
+                pollfd.events = POLLRDNORM;
+                ULONGLONG parked = Now();
+                int ready = ::WSAPoll(&pollfd, 1, _policy.park_timeout_ms);
+                _stats.park_us += Now() - parked;
+                if (ready == SOCKET_ERROR)
+                    throw WSAGetLastError();
+                ++_stats.park_wakeups;
+
+                auto result = receive();
+                if (!result.WouldBlock() || ready == 0)
+                    return result;
+            }
+        }
+
+    public:
+
+        BusyPoller(const BusyPollPolicy& policy = BusyPollPolicy { 5, 200, -1 }) :
+            _policy(policy), _stats(), _spin_us(policy.max_spin_us), _attached(INVALID_SOCKET) {
+            LARGE_INTEGER frequency;
+            ::QueryPerformanceFrequency(&frequency);
+            _frequency = frequency.QuadPart;
+        }
+
+        const BusyPollStats& GetStats() const {
+            return _stats;
+        }
+
+        void ResetStats() {
+            _stats = BusyPollStats();
+        }
+
+        ULONGLONG GetSpinBudget() const {
+            return _spin_us;
+        }
+
+        // Spinning needs a non-blocking socket. Receive switches each new socket over
+        // on first use; call Attach again if a socket may have been made blocking
+        // since, or if a closed descriptor value was reused.
+        template<int _AF, int _SocketType, int _Protocol>
+        void Attach(const Socket<_AF, _SocketType, _Protocol>& socket) throw(DWORD) {
+            socket.SetNonBlocking(true);
+            _attached = socket.GetDescriptor();
+        }
+
+        template<int _AF>
+        Result<int> Receive(const TCPCommunicateSocket<_AF>& socket, void* buffer, int length, int flag = 0) throw(DWORD) {
+            Ensure(socket);
+            return Poll(socket.GetDescriptor(), [&]() { return socket.TryReceive(buffer, length, flag); });
+        }
+
+        template<int _AF>
+        Result<typename UDPSocket<_AF>::ReceiveInfo> ReceiveFrom(const UDPSocket<_AF>& socket, void* buffer, int length, int flag = 0) throw(DWORD) {
+            Ensure(socket);
+            return Poll(socket.GetDescriptor(), [&]() { return socket.TryReceiveFrom(buffer, length, flag); });
+        }
+
+    };
+
+}
@@ -0,0 +1,287 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "Resolver.hpp"
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+
+namespace tinySocket {
+
+    inline SocketAddr<AF_INET6> MapAddress(const SocketAddr<AF_INET>& address) {
+        SocketAddr<AF_INET6> mapped;
+        ZeroMemory(&mapped, sizeof(mapped));
+        mapped.sin6_family = AF_INET6;
+        mapped.sin6_port = address.sin_port;
+        mapped.sin6_addr.u.Byte[10] = 0xff;
+        mapped.sin6_addr.u.Byte[11] = 0xff;
+        memcpy(&mapped.sin6_addr.u.Byte[12], &address.sin_addr, sizeof(address.sin_addr));
+        return mapped;
+    }
+
+    //----------------------------
+    //  Happy Eyeballs (RFC 8305)
+    //----------------------------
+
+    inline TCPCommunicateSocket<AF_INET6> HappyEyeballsConnect(Resolver<AF_INET6>& resolver6,
+                                                               Resolver<AF_INET>& resolver4,
+                                                               const TCHAR* HostName, u_short Port,
+                                                               DWORD attempt_delay = 250,
+                                                               DWORD timeout = 10000) throw(DWORD) {
+        Resolver<AF_INET6>::AddressList addresses6;
+        Resolver<AF_INET>::AddressList addresses4;
+        DWORD error = WSAHOST_NOT_FOUND;
+        try {
+            addresses6 = resolver6.Resolve(HostName, Port);
+        } catch (DWORD e) {
+            error = e;
+        }
+        try {
+            addresses4 = resolver4.Resolve(HostName, Port);
+        } catch (DWORD e) {
+            error = e;
+        }
+
+        std::vector<SocketAddr<AF_INET6>> candidates;
+        for (size_t i = 0; i < addresses6.size() || i < addresses4.size(); ++i) {
+            if (i < addresses6.size())
+                candidates.push_back(addresses6[i]);
+            if (i < addresses4.size())
+                candidates.push_back(MapAddress(addresses4[i]));
+        }
+        if (candidates.empty())
+            throw error;
+
+        ULONGLONG deadline = ::GetTickCount64() + timeout;
+        ULONGLONG next_attempt = 0;
+        size_t next = 0;
+        std::vector<TCPCommunicateSocket<AF_INET6>> attempts;
+
+        for (;;) {
+            ULONGLONG now = ::GetTickCount64();
+            if (now >= deadline)
+                throw WSAETIMEDOUT;
+
+            if (next < candidates.size() && (now >= next_attempt || attempts.empty())) {
+                TCPCommunicateSocket<AF_INET6> attempt;
+                DWORD V6Only = FALSE;
+                attempt.SetSocketOption(IPPROTO_IPV6, IPV6_V6ONLY, &V6Only, sizeof(V6Only));
+                attempt.SetNonBlocking(true);
+                const SocketAddr<AF_INET6>& to = candidates[next++];
+                if (::connect(attempt.GetDescriptor(), reinterpret_cast<const sockaddr*>(&to), sizeof(to)) == 0) {
+                    attempt.SetNonBlocking(false);
+                    return attempt;
+                }
+                error = WSAGetLastError();
+                if (error == WSAEWOULDBLOCK) {
+                    attempts.push_back(std::move(attempt));
+                    next_attempt = now + attempt_delay;
+                } else {
+                    next_attempt = 0;
+                }
+                continue;
+            }
+
+            if (attempts.empty())
+                throw error;
+
+            fd_set writefds;
+            fd_set exceptfds;
+            FD_ZERO(&writefds);
+            FD_ZERO(&exceptfds);
+            for (const TCPCommunicateSocket<AF_INET6>& attempt : attempts) {
+                FD_SET(attempt.GetDescriptor(), &writefds);
+                FD_SET(attempt.GetDescriptor(), &exceptfds);
+            }
+
+            ULONGLONG wake = deadline;
+            if (next < candidates.size() && next_attempt < wake)
+                wake = next_attempt;
+            timeval wait = { };
+            wait.tv_sec = static_cast<long>((wake - now) / 1000);
+            wait.tv_usec = static_cast<long>((wake - now) % 1000 * 1000);
+            if (::select(0, nullptr, &writefds, &exceptfds, &wait) == SOCKET_ERROR)
+                throw WSAGetLastError();
+
+            for (size_t i = 0; i < attempts.size(); ) {
+                SOCKET descriptor = attempts[i].GetDescriptor();
+                if (FD_ISSET(descriptor, &writefds)) {
+                    TCPCommunicateSocket<AF_INET6> connected = std::move(attempts[i]);
+                    connected.SetNonBlocking(false);
+                    return connected;
+                }
+                if (FD_ISSET(descriptor, &exceptfds)) {
+                    error = attempts[i].GetLastError();
+                    attempts.erase(attempts.begin() + i);
+                    next_attempt = 0;
+                    continue;
+                }
+                ++i;
+            }
+        }
+    }
+
+    class ConnectionPool {
+    public:
+
+        typedef TCPCommunicateSocket<AF_INET6> Connection;
+        typedef std::pair<std::basic_string<TCHAR>, u_short> Endpoint;
+
+        class Lease {
+            friend class ConnectionPool;
+        private:
+            ConnectionPool* _pool;
+            Endpoint _endpoint;
+            Connection _connection;
+            bool _reusable;
+
+            Lease(ConnectionPool* pool, const Endpoint& endpoint, Connection&& connection) :
+                _pool(pool), _endpoint(endpoint), _connection(std::move(connection)), _reusable(true) { }
+
+        public:
+
+            Lease(const Lease&) = delete;
+
+            Lease(Lease&& other) :
+                _pool(other._pool), _endpoint(other._endpoint),
+                _connection(std::move(other._connection)), _reusable(other._reusable) {
+                other._pool = nullptr;
+            }
+
+            Lease& operator=(const Lease&) = delete;
+
+            ~Lease() {
+                if (_pool != nullptr)
+                    _pool->Release(_endpoint, std::move(_connection), _reusable);
+            }
+
+            Connection& operator*() {
+                return _connection;
+            }
+
+            Connection* operator->() {
+                return &_connection;
+            }
+
+            void Discard() {
+                _reusable = false;
+            }
+
+        };
+
+    private:
+
+        struct Idle {
+            Connection connection;
+            std::chrono::steady_clock::time_point since;
+        };
+
+        struct Slot {
+            std::deque<Idle> idle;
+            size_t open;
+        };
+
+        std::mutex _mutex;
+        std::condition_variable _released;
+        std::map<Endpoint, Slot> _slots;
+        Resolver<AF_INET6>& _resolver6;
+        Resolver<AF_INET>& _resolver4;
+        size_t _max_per_endpoint;
+        std::chrono::milliseconds _idle_timeout;
+        DWORD _attempt_delay;
+        DWORD _connect_timeout;
+
+        static bool IsAlive(const Connection& connection) {
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(connection.GetDescriptor(), &readfds);
+            timeval wait = { };
+            return ::select(0, &readfds, nullptr, nullptr, &wait) == 0;
+        }
+
+        void Evict(Slot& slot, std::chrono::steady_clock::time_point now) {
+            while (!slot.idle.empty() && now - slot.idle.front().since >= _idle_timeout) {
+                slot.idle.pop_front();
+                --slot.open;
+            }
+        }
+
+        void Release(const Endpoint& endpoint, Connection&& connection, bool reusable) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                Slot& slot = _slots[endpoint];
+                if (reusable && connection.GetDescriptor() != INVALID_SOCKET)
+                    slot.idle.push_back(Idle { std::move(connection), std::chrono::steady_clock::now() });
+                else
+                    --slot.open;
+            }
+            _released.notify_one();
+        }
+
+    public:
+
+        ConnectionPool(size_t max_per_endpoint = 8,
+                       std::chrono::milliseconds idle_timeout = std::chrono::seconds(30),
+                       DWORD attempt_delay = 250,
+                       DWORD connect_timeout = 10000,
+                       Resolver<AF_INET6>& resolver6 = Resolver<AF_INET6>::Default(),
+                       Resolver<AF_INET>& resolver4 = Resolver<AF_INET>::Default()) :
+            _resolver6(resolver6), _resolver4(resolver4),
+            _max_per_endpoint(max_per_endpoint), _idle_timeout(idle_timeout),
+            _attempt_delay(attempt_delay), _connect_timeout(connect_timeout) { }
+
+        ConnectionPool(const ConnectionPool&) = delete;
+
+        ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+        Lease Acquire(const TCHAR* HostName, u_short Port) throw(DWORD) {
+            Endpoint endpoint(HostName, Port);
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Slot& slot = _slots[endpoint];
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_connect_timeout);
+                for (;;) {
+                    auto now = std::chrono::steady_clock::now();
+                    Evict(slot, now);
+                    while (!slot.idle.empty()) {
+                        Connection connection = std::move(slot.idle.back().connection);
+                        slot.idle.pop_back();
+                        if (IsAlive(connection))
+                            return Lease(this, endpoint, std::move(connection));
+                        --slot.open;
+                    }
+                    if (slot.open < _max_per_endpoint)
+                        break;
+                    if (_released.wait_until(lock, deadline) == std::cv_status::timeout)
+                        throw WSAETIMEDOUT;
+                }
+                ++slot.open;
+            }
+
+            try {
+                return Lease(this, endpoint,
+                             HappyEyeballsConnect(_resolver6, _resolver4, HostName, Port,
+                                                  _attempt_delay, _connect_timeout));
+            } catch (DWORD) {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    --_slots[endpoint].open;
+                }
+                _released.notify_one();
+                throw;
+            }
+        }
+
+        void EvictIdle() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto now = std::chrono::steady_clock::now();
+            for (auto& it : _slots)
+                Evict(it.second, now);
+        }
+
+    };
+
+}
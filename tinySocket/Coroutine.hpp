@@ -0,0 +1,470 @@
+#pragma once
+#include "Reactor.hpp"
+#include "Buffer.hpp"
+#include "UDPSocket.hpp"
+#include <coroutine>
+#include <optional>
+#include <exception>
+
+namespace tinySocket {
+
+    struct PooledFrame {
+
+        static void* operator new(size_t size) {
+            return BufferPool::Allocate(size);
+        }
+
+        static void operator delete(void* frame, size_t size) {
+            BufferPool::Free(frame, size);
+        }
+
+    };
+
+    template<typename _Ty = void>
+    class Task;
+
+    template<typename _Ty>
+    struct TaskPromiseBase : PooledFrame {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            template<typename _Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<_Promise> handle) noexcept {
+                std::coroutine_handle<> next = handle.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept { }
+        };
+
+        std::suspend_always initial_suspend() noexcept {
+            return { };
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return { };
+        }
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+        }
+    };
+
+    template<typename _Ty>
+    struct TaskPromise : TaskPromiseBase<_Ty> {
+        std::optional<_Ty> value;
+
+        Task<_Ty> get_return_object();
+
+        template<typename _Value>
+        void return_value(_Value&& result) {
+            value.emplace(std::forward<_Value>(result));
+        }
+
+        _Ty Take() {
+            if (this->exception)
+                std::rethrow_exception(this->exception);
+            return std::move(*value);
+        }
+    };
+
+    template<>
+    struct TaskPromise<void> : TaskPromiseBase<void> {
+
+        Task<void> get_return_object();
+
+        void return_void() { }
+
+        void Take() {
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+    };
+
+    template<typename _Ty>
+    class Task {
+    public:
+
+        typedef TaskPromise<_Ty> promise_type;
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+    public:
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) { }
+
+        Task(const Task<_Ty>&) = delete;
+
+        Task(Task<_Ty>&& other) : _handle(other._handle) {
+            other._handle = nullptr;
+        }
+
+        Task<_Ty>& operator=(const Task<_Ty>&) = delete;
+
+        Task<_Ty>& operator=(Task<_Ty>&& other) {
+            if (this != &other) {
+                if (_handle)
+                    _handle.destroy();
+                _handle = other._handle;
+                other._handle = nullptr;
+            }
+            return *this;
+        }
+
+        ~Task() {
+            if (_handle)
+                _handle.destroy();
+        }
+
+        bool await_ready() const {
+            return !_handle || _handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            _handle.promise().continuation = awaiting;
+            return _handle;
+        }
+
+        _Ty await_resume() {
+            return _handle.promise().Take();
+        }
+
+    };
+
+    template<typename _Ty>
+    Task<_Ty> TaskPromise<_Ty>::get_return_object() {
+        return Task<_Ty>(std::coroutine_handle<TaskPromise<_Ty>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    class Scheduler {
+    public:
+
+        struct Waiter {
+            void (*ready)(Waiter*);
+            void (*fail)(Waiter*, DWORD);
+        };
+
+    private:
+
+        struct Waiters {
+            Waiter* reader;
+            Waiter* writer;
+        };
+
+        struct Detached {
+            struct promise_type : PooledFrame {
+                Scheduler* scheduler;
+
+                promise_type(Scheduler& owner, Task<void>&) : scheduler(&owner) {
+                    ++scheduler->_active;
+                }
+
+                ~promise_type() {
+                    --scheduler->_active;
+                }
+
+                Detached get_return_object() {
+                    return { };
+                }
+
+                std::suspend_never initial_suspend() noexcept {
+                    return { };
+                }
+
+                std::suspend_never final_suspend() noexcept {
+                    return { };
+                }
+
+                void return_void() { }
+
+                void unhandled_exception() {
+                    if (!scheduler->_failure)
+                        scheduler->_failure = std::current_exception();
+                    scheduler->_reactor.Stop();
+                }
+            };
+        };
+
+        Reactor& _reactor;
+        std::unordered_map<SOCKET, Waiters> _waiters;
+        std::exception_ptr _failure;
+        size_t _active;
+
+        static Detached Launch(Scheduler&, Task<void> task) {
+            co_await task;
+        }
+
+        static SHORT EventsOf(const Waiters& waiters) {
+            return (waiters.reader != nullptr ? ReactorRead : 0) | (waiters.writer != nullptr ? ReactorWrite : 0);
+        }
+
+        void Update(SOCKET descriptor, const Waiters& waiters) throw(DWORD) {
+            SHORT events = EventsOf(waiters);
+            if (events == 0) {
+                _waiters.erase(descriptor);
+                _reactor.Remove(descriptor);
+            } else {
+                _reactor.Modify(descriptor, events);
+            }
+        }
+
+        void Dispatch(SOCKET descriptor, SHORT revents) throw(DWORD) {
+            auto it = _waiters.find(descriptor);
+            if (it == _waiters.end())
+                return;
+
+            const SHORT failed = ReactorError | ReactorHangup | ReactorInvalid;
+            Waiter* reader = nullptr;
+            Waiter* writer = nullptr;
+            if (revents & (ReactorRead | failed))
+                std::swap(reader, it->second.reader);
+            if (revents & (ReactorWrite | failed))
+                std::swap(writer, it->second.writer);
+            Update(descriptor, it->second);
+
+            if (reader != nullptr)
+                reader->ready(reader);
+            if (writer != nullptr)
+                writer->ready(writer);
+        }
+
+    public:
+
+        Scheduler(Reactor& reactor) : _reactor(reactor), _active(0) { }
+
+        Scheduler(const Scheduler&) = delete;
+
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        Reactor& GetReactor() const {
+            return _reactor;
+        }
+
+        size_t GetActiveCount() const {
+            return _active;
+        }
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Attach(const Socket<_AF, _SocketType, _Protocol>& socket) const throw(DWORD) {
+            socket.SetNonBlocking(true);
+        }
+
+        void Wait(SOCKET descriptor, SHORT event, Waiter* waiter) throw(DWORD) {
+            auto it = _waiters.find(descriptor);
+            if (it == _waiters.end()) {
+                Waiters waiters = { };
+                (event == ReactorRead ? waiters.reader : waiters.writer) = waiter;
+                _reactor.Register(descriptor, event, [this](SOCKET s, SHORT revents) { Dispatch(s, revents); });
+                _waiters.emplace(descriptor, waiters);
+                return;
+            }
+
+            Waiter*& slot = event == ReactorRead ? it->second.reader : it->second.writer;
+            if (slot != nullptr)
+                throw WSAEALREADY;
+            slot = waiter;
+            _reactor.Modify(descriptor, EventsOf(it->second));
+        }
+
+        void Cancel(SOCKET descriptor) throw(DWORD) {
+            if (_waiters.erase(descriptor) != 0)
+                _reactor.Remove(descriptor);
+        }
+
+        // Fails only the operation waiting for event (ReactorRead or ReactorWrite);
+        // an operation in the other direction on the same socket keeps waiting.
+        void Expire(SOCKET descriptor, SHORT event, DWORD error = WSAETIMEDOUT) throw(DWORD) {
+            auto it = _waiters.find(descriptor);
+            if (it == _waiters.end())
+                return;
+
+            Waiter* waiter = nullptr;
+            std::swap(waiter, event == ReactorRead ? it->second.reader : it->second.writer);
+            if (waiter == nullptr)
+                return;
+            Update(descriptor, it->second);
+            waiter->fail(waiter, error);
+        }
+
+        // The awaitable is taken by value and kept in this frame, so a temporary
+        // passed by the caller outlives the suspension. When the deadline fires,
+        // Expire resumes the awaiting coroutine, which may finish and destroy this
+        // frame, timer included, before the timer callback returns; TimerWheel
+        // runs callbacks from a local for exactly this case.
+        template<typename _Awaitable>
+        auto WithDeadline(SOCKET descriptor, SHORT event, ULONGLONG timeout, _Awaitable awaitable)
+            -> Task<decltype(std::declval<_Awaitable&>().await_resume())> {
+            TimerWheel* timers = _reactor.GetTimerWheel();
+            if (timers == nullptr)
+                co_return co_await std::move(awaitable);
+
+            Timer deadline([this, descriptor, event]() { Expire(descriptor, event); });
+            timers->Schedule(deadline, timeout);
+            co_return co_await std::move(awaitable);
+        }
+
+        void Spawn(Task<void> task) {
+            Launch(*this, std::move(task));
+        }
+
+        void Run() {
+            _failure = nullptr;
+            while (_active != 0 && !_failure)
+                _reactor.RunOnce(-1);
+            if (_failure)
+                std::rethrow_exception(_failure);
+        }
+
+    };
+
+    //----------------------------
+    //  Awaiters
+    //----------------------------
+
+    template<typename _Ty, typename _Operation>
+    class IoAwaiter : private Scheduler::Waiter {
+    private:
+        Scheduler& _scheduler;
+        SOCKET _descriptor;
+        SHORT _event;
+        _Operation _operation;
+        std::optional<Result<_Ty>> _result;
+        std::coroutine_handle<> _handle;
+
+        static void Ready(Scheduler::Waiter* waiter) {
+            IoAwaiter* self = static_cast<IoAwaiter*>(waiter);
+            self->_result.emplace(self->_operation());
+            if (self->_result->WouldBlock()) {
+                self->_scheduler.Wait(self->_descriptor, self->_event, self);
+                return;
+            }
+            self->_handle.resume();
+        }
+
+        static void Fail(Scheduler::Waiter* waiter, DWORD error) {
+            IoAwaiter* self = static_cast<IoAwaiter*>(waiter);
+            self->_result.emplace(Result<_Ty>::Error(error));
+            self->_handle.resume();
+        }
+
+    public:
+
+        IoAwaiter(Scheduler& scheduler, SOCKET descriptor, SHORT event, _Operation operation) :
+            _scheduler(scheduler), _descriptor(descriptor), _event(event), _operation(std::move(operation)) {
+            ready = &IoAwaiter::Ready;
+            fail = &IoAwaiter::Fail;
+        }
+
+        bool await_ready() {
+            _result.emplace(_operation());
+            return !_result->WouldBlock();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            _handle = handle;
+            _scheduler.Wait(_descriptor, _event, this);
+        }
+
+        Result<_Ty> await_resume() {
+            return std::move(*_result);
+        }
+
+    };
+
+    template<typename _Ty, typename _Operation>
+    IoAwaiter<_Ty, _Operation> MakeAwaiter(Scheduler& scheduler, SOCKET descriptor, SHORT event, _Operation operation) {
+        return IoAwaiter<_Ty, _Operation>(scheduler, descriptor, event, std::move(operation));
+    }
+
+    template<int _AF>
+    auto AsyncAccept(Scheduler& scheduler, const TCPListenSocket<_AF>& listener) {
+        return MakeAwaiter<TCPCommunicateSocket<_AF>>(scheduler, listener.GetDescriptor(), ReactorRead,
+            [&listener]() { return listener.TryAccept(); });
+    }
+
+    template<int _AF>
+    auto AsyncConnect(Scheduler& scheduler, const TCPCommunicateSocket<_AF>& socket, const SocketAddr<_AF>& to) {
+        SOCKET descriptor = socket.GetDescriptor();
+        bool started = false;
+        return MakeAwaiter<int>(scheduler, descriptor, ReactorWrite, [descriptor, to, started]() mutable -> Result<int> {
+            if (!started) {
+                started = true;
+                if (::connect(descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) == 0)
+                    return 0;
+                return Result<int>::Error(WSAGetLastError());
+            }
+
+            DWORD error = 0;
+            int error_size = sizeof(error);
+            if (::getsockopt(descriptor, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &error_size) != 0)
+                return Result<int>::Error(WSAGetLastError());
+            if (error != 0)
+                return Result<int>::Error(error);
+            return 0;
+        });
+    }
+
+    template<int _AF>
+    auto AsyncSend(Scheduler& scheduler, const TCPCommunicateSocket<_AF>& socket, const void* buffer, int length, int flag = 0) {
+        return MakeAwaiter<int>(scheduler, socket.GetDescriptor(), ReactorWrite,
+            [&socket, buffer, length, flag]() { return socket.TrySend(buffer, length, flag); });
+    }
+
+    template<int _AF>
+    auto AsyncReceive(Scheduler& scheduler, const TCPCommunicateSocket<_AF>& socket, void* buffer, int length, int flag = 0) {
+        return MakeAwaiter<int>(scheduler, socket.GetDescriptor(), ReactorRead,
+            [&socket, buffer, length, flag]() { return socket.TryReceive(buffer, length, flag); });
+    }
+
+    template<int _AF>
+    auto AsyncSendTo(Scheduler& scheduler, const UDPSocket<_AF>& socket, const void* buffer, int length,
+                     const SocketAddr<_AF>& to, int flag = 0) {
+        return MakeAwaiter<int>(scheduler, socket.GetDescriptor(), ReactorWrite,
+            [&socket, buffer, length, to, flag]() { return socket.TrySendTo(buffer, length, to, flag); });
+    }
+
+    template<int _AF>
+    auto AsyncReceiveFrom(Scheduler& scheduler, const UDPSocket<_AF>& socket, void* buffer, int length, int flag = 0) {
+        return MakeAwaiter<typename UDPSocket<_AF>::ReceiveInfo>(scheduler, socket.GetDescriptor(), ReactorRead,
+            [&socket, buffer, length, flag]() { return socket.TryReceiveFrom(buffer, length, flag); });
+    }
+
+    template<int _AF>
+    Task<Result<int>> AsyncSendAll(Scheduler& scheduler, const TCPCommunicateSocket<_AF>& socket, const void* buffer, int length) {
+        const char* data = reinterpret_cast<const char*>(buffer);
+        int sent = 0;
+        while (sent < length) {
+            Result<int> result = co_await AsyncSend(scheduler, socket, data + sent, length - sent);
+            if (!result)
+                co_return result;
+            sent += result.Value();
+        }
+        co_return sent;
+    }
+
+    template<int _AF>
+    Task<Result<int>> AsyncReceiveExact(Scheduler& scheduler, const TCPCommunicateSocket<_AF>& socket, void* buffer, int length) {
+        char* data = reinterpret_cast<char*>(buffer);
+        int received = 0;
+        while (received < length) {
+            Result<int> result = co_await AsyncReceive(scheduler, socket, data + received, length - received);
+            if (!result)
+                co_return result;
+            if (result.Value() == 0)
+                co_return Result<int>::Error(WSAEDISCON);
+            received += result.Value();
+        }
+        co_return received;
+    }
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <Windows.h>
+#include <intrin.h>
+#include <string>
+#include <sstream>
+
+namespace tinySocket {
+
+    class DelayHistogram {
+    public:
+
+        static const int SubBucketBits = 3;
+        static const int SubBucketCount = 1 << SubBucketBits;
+        static const int BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+    private:
+        ULONGLONG _buckets[BucketCount];
+        ULONGLONG _count;
+        ULONGLONG _sum;
+        ULONGLONG _min;
+        ULONGLONG _max;
+        LONGLONG _frequency;
+
+        static int IndexOf(ULONGLONG value) {
+            if (value < SubBucketCount)
+                return static_cast<int>(value);
+            unsigned long msb;
+            _BitScanReverse64(&msb, value);
+            int shift = static_cast<int>(msb) - SubBucketBits;
+            return (shift + 1) * SubBucketCount + static_cast<int>((value >> shift) & (SubBucketCount - 1));
+        }
+
+        static ULONGLONG UpperBoundOf(int index) {
+            if (index < SubBucketCount)
+                return static_cast<ULONGLONG>(index);
+            int shift = index / SubBucketCount - 1;
+            ULONGLONG base = static_cast<ULONGLONG>(SubBucketCount + index % SubBucketCount) << shift;
+            return base + ((1ULL << shift) - 1);
+        }
+
+    public:
+
+        DelayHistogram() {
+            LARGE_INTEGER frequency;
+            ::QueryPerformanceFrequency(&frequency);
+            _frequency = frequency.QuadPart;
+            Reset();
+        }
+
+        void Reset() {
+            for (int i = 0; i < BucketCount; ++i)
+                _buckets[i] = 0;
+            _count = 0;
+            _sum = 0;
+            _min = ~0ULL;
+            _max = 0;
+        }
+
+        ULONGLONG ToNanoseconds(ULONGLONG ticks) const {
+            ULONGLONG frequency = static_cast<ULONGLONG>(_frequency);
+            return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+        }
+
+        void Record(ULONGLONG delay_ns) {
+            ++_buckets[IndexOf(delay_ns)];
+            ++_count;
+            _sum += delay_ns;
+            if (delay_ns < _min)
+                _min = delay_ns;
+            if (delay_ns > _max)
+                _max = delay_ns;
+        }
+
+        void RecordTimestamps(ULONGLONG kernel, ULONGLONG application) {
+            if (kernel == 0)
+                return;
+            Record(application > kernel ? ToNanoseconds(application - kernel) : 0);
+        }
+
+        void RecordSince(ULONGLONG kernel) {
+            LARGE_INTEGER now;
+            ::QueryPerformanceCounter(&now);
+            RecordTimestamps(kernel, static_cast<ULONGLONG>(now.QuadPart));
+        }
+
+        void Merge(const DelayHistogram& other) {
+            if (other._count == 0)
+                return;
+            for (int i = 0; i < BucketCount; ++i)
+                _buckets[i] += other._buckets[i];
+            _count += other._count;
+            _sum += other._sum;
+            if (other._min < _min)
+                _min = other._min;
+            if (other._max > _max)
+                _max = other._max;
+        }
+
+        ULONGLONG GetCount() const {
+            return _count;
+        }
+
+        ULONGLONG GetMin() const {
+            return _count == 0 ? 0 : _min;
+        }
+
+        ULONGLONG GetMax() const {
+            return _max;
+        }
+
+        ULONGLONG GetMean() const {
+            return _count == 0 ? 0 : _sum / _count;
+        }
+
+        ULONGLONG GetPercentile(double percentile) const {
+            if (_count == 0)
+                return 0;
+            ULONGLONG rank = static_cast<ULONGLONG>(percentile * _count);
+            if (rank >= _count)
+                rank = _count - 1;
+            ULONGLONG seen = 0;
+            for (int i = 0; i < BucketCount; ++i) {
+                seen += _buckets[i];
+                if (seen > rank)
+                    return UpperBoundOf(i) < _max ? UpperBoundOf(i) : _max;
+            }
+            return _max;
+        }
+
+        std::string DumpJson() const {
+            std::ostringstream out;
+            out << "{\"count\":" << _count
+                << ",\"min_ns\":" << GetMin()
+                << ",\"mean_ns\":" << GetMean()
+                << ",\"p50_ns\":" << GetPercentile(0.5)
+                << ",\"p99_ns\":" << GetPercentile(0.99)
+                << ",\"p999_ns\":" << GetPercentile(0.999)
+                << ",\"max_ns\":" << _max << "}";
+            return out.str();
+        }
+
+    };
+
+}
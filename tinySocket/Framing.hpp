@@ -0,0 +1,290 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "Buffer.hpp"
+#include <vector>
+#include <cstring>
+
+namespace tinySocket {
+
+    //----------------------------
+    //  Codecs
+    //----------------------------
+
+    template<size_t _HeaderBytes>
+    struct LengthPrefixCodec {
+        static const size_t MaxHeader = _HeaderBytes;
+        static const size_t MaxTrailer = 0;
+        static const size_t MaxLength = _HeaderBytes >= sizeof(size_t) ? ~static_cast<size_t>(0)
+                                      : ~static_cast<size_t>(0) >> (8 * (sizeof(size_t) - _HeaderBytes));
+
+        static bool Decode(const char* data, size_t size, size_t& offset, size_t& length, size_t& consumed) {
+            if (size < _HeaderBytes)
+                return false;
+            length = 0;
+            for (size_t i = 0; i < _HeaderBytes; ++i)
+                length = (length << 8) | static_cast<unsigned char>(data[i]);
+            if (size - _HeaderBytes < length)
+                return false;
+            offset = _HeaderBytes;
+            consumed = _HeaderBytes + length;
+            return true;
+        }
+
+        static DWORD Check(const char*, size_t length) {
+            return length > MaxLength ? WSAEMSGSIZE : 0;
+        }
+
+        static size_t EncodeHeader(char* out, size_t length) {
+            for (size_t i = 0; i < _HeaderBytes; ++i)
+                out[i] = static_cast<char>(length >> (8 * (_HeaderBytes - 1 - i)));
+            return _HeaderBytes;
+        }
+
+        static size_t EncodeTrailer(char*) {
+            return 0;
+        }
+    };
+
+    struct VarintCodec {
+        static const size_t MaxHeader = 10;
+        static const size_t MaxTrailer = 0;
+        static const size_t MaxLength = ~static_cast<size_t>(0);
+
+        static bool Decode(const char* data, size_t size, size_t& offset, size_t& length, size_t& consumed) throw(DWORD) {
+            ULONGLONG value = 0;
+            size_t i = 0;
+            for (;;) {
+                if (i == size)
+                    return false;
+                if (i == MaxHeader)
+                    throw WSAEMSGSIZE;
+                unsigned char byte = static_cast<unsigned char>(data[i]);
+                value |= static_cast<ULONGLONG>(byte & 0x7f) << (7 * i);
+                ++i;
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+            if (size - i < value)
+                return false;
+            offset = i;
+            length = static_cast<size_t>(value);
+            consumed = i + length;
+            return true;
+        }
+
+        static DWORD Check(const char*, size_t) {
+            return 0;
+        }
+
+        static size_t EncodeHeader(char* out, size_t length) {
+            size_t i = 0;
+            ULONGLONG value = length;
+            while (value >= 0x80) {
+                out[i++] = static_cast<char>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            out[i++] = static_cast<char>(value);
+            return i;
+        }
+
+        static size_t EncodeTrailer(char*) {
+            return 0;
+        }
+    };
+
+    template<char _Delimiter>
+    struct DelimiterCodec {
+        static const size_t MaxHeader = 0;
+        static const size_t MaxTrailer = 1;
+        static const size_t MaxLength = ~static_cast<size_t>(0);
+
+        static bool Decode(const char* data, size_t size, size_t& offset, size_t& length, size_t& consumed) {
+            const char* end = static_cast<const char*>(memchr(data, _Delimiter, size));
+            if (end == nullptr)
+                return false;
+            offset = 0;
+            length = static_cast<size_t>(end - data);
+            consumed = length + 1;
+            return true;
+        }
+
+        // The delimiter is not escaped, so a payload containing it would be split
+        // into corrupt frames on the receiving side.
+        static DWORD Check(const char* data, size_t length) {
+            return memchr(data, _Delimiter, length) != nullptr ? WSAEINVAL : 0;
+        }
+
+        static size_t EncodeHeader(char*, size_t) {
+            return 0;
+        }
+
+        static size_t EncodeTrailer(char* out) {
+            out[0] = _Delimiter;
+            return 1;
+        }
+    };
+
+    //----------------------------
+    //  FrameReader
+    //----------------------------
+
+    template<typename _Codec>
+    class FrameReader {
+    private:
+        MirroredRingBuffer _buffer;
+        size_t _max_frame;
+
+    public:
+
+        FrameReader(size_t buffer_size = 65536) throw(DWORD) : _buffer(buffer_size) {
+            _max_frame = _buffer.GetCapacity() - _Codec::MaxHeader - _Codec::MaxTrailer;
+        }
+
+        MirroredRingBuffer& GetBuffer() {
+            return _buffer;
+        }
+
+        template<typename _Handler>
+        size_t Parse(_Handler&& handler) throw(DWORD) {
+            size_t frames = 0;
+            for (;;) {
+                size_t readable = _buffer.GetReadableSize();
+                if (readable == 0)
+                    break;
+
+                const char* data = _buffer.GetReadPointer();
+                size_t offset = 0;
+                size_t length = 0;
+                size_t consumed = 0;
+                if (!_Codec::Decode(data, readable, offset, length, consumed)) {
+                    if (readable == _buffer.GetCapacity())
+                        throw WSAEMSGSIZE;
+                    break;
+                }
+                if (length > _max_frame)
+                    throw WSAEMSGSIZE;
+
+                handler(data + offset, length);
+                _buffer.Consume(consumed);
+                ++frames;
+            }
+            return frames;
+        }
+
+        template<int _AF, typename _Handler>
+        Result<int> Receive(const TCPCommunicateSocket<_AF>& socket, _Handler&& handler, int flag = 0) throw(DWORD) {
+            Result<int> received = _buffer.Receive(socket, flag);
+            if (received && received.Value() > 0)
+                Parse(handler);
+            return received;
+        }
+
+    };
+
+    //----------------------------
+    //  FrameWriter
+    //----------------------------
+
+    template<typename _Codec>
+    class FrameWriter {
+    private:
+
+        struct Piece {
+            const char* data;
+            size_t offset;
+            size_t length;
+        };
+
+        std::vector<char> _headers;
+        std::vector<Piece> _pieces;
+        std::vector<WSABUF> _buffers;
+        size_t _first;
+
+        // Drops bytes already written so that a Flush interrupted by
+        // WSAEWOULDBLOCK resumes where it stopped instead of resending frames.
+        void Consume(size_t length) {
+            while (_first < _pieces.size() && length >= _pieces[_first].length) {
+                length -= _pieces[_first].length;
+                ++_first;
+            }
+            if (_first < _pieces.size() && length != 0) {
+                Piece& piece = _pieces[_first];
+                if (piece.data != nullptr)
+                    piece.data += length;
+                else
+                    piece.offset += length;
+                piece.length -= length;
+            }
+        }
+
+        void AddHeader(size_t length, bool trailer) {
+            size_t offset = _headers.size();
+            size_t capacity = _Codec::MaxHeader;
+            if (trailer)
+                capacity = _Codec::MaxTrailer;
+            _headers.resize(offset + capacity);
+            size_t written = trailer ? _Codec::EncodeTrailer(_headers.data() + offset)
+                                     : _Codec::EncodeHeader(_headers.data() + offset, length);
+            _headers.resize(offset + written);
+            if (written != 0)
+                _pieces.push_back(Piece { nullptr, offset, written });
+        }
+
+    public:
+
+        FrameWriter() : _first(0) { }
+
+        // Payloads are referenced, not copied: each one must stay alive and
+        // unchanged until the Flush that sends its last byte has returned.
+        void Add(const void* payload, size_t length) throw(DWORD) {
+            if (length > MAXDWORD)
+                throw WSAEMSGSIZE;
+            DWORD error = _Codec::Check(reinterpret_cast<const char*>(payload), length);
+            if (error != 0)
+                throw error;
+            AddHeader(length, false);
+            if (length != 0)
+                _pieces.push_back(Piece { reinterpret_cast<const char*>(payload), 0, length });
+            AddHeader(length, true);
+        }
+
+        size_t GetPendingCount() const {
+            return _pieces.size() - _first;
+        }
+
+        WSABUF* GetBuffers() {
+            _buffers.resize(GetPendingCount());
+            for (size_t i = _first; i < _pieces.size(); ++i) {
+                const Piece& piece = _pieces[i];
+                const char* data = piece.data != nullptr ? piece.data : _headers.data() + piece.offset;
+                _buffers[i - _first].buf = const_cast<char*>(data);
+                _buffers[i - _first].len = static_cast<ULONG>(piece.length);
+            }
+            return _buffers.data();
+        }
+
+        void Clear() {
+            _headers.clear();
+            _pieces.clear();
+            _first = 0;
+        }
+
+        // On a non-blocking socket Flush may throw WSAEWOULDBLOCK part way through;
+        // the bytes already sent are recorded and the next Flush sends the rest.
+        template<int _AF>
+        int Flush(const TCPCommunicateSocket<_AF>& socket, int flag = 0) throw(DWORD) {
+            int total = 0;
+            while (GetPendingCount() != 0) {
+                Result<int> sent = socket.TrySend(GetBuffers(), static_cast<int>(GetPendingCount()), flag);
+                if (!sent)
+                    throw sent.GetError();
+                total += sent.Value();
+                Consume(static_cast<size_t>(sent.Value()));
+            }
+            Clear();
+            return total;
+        }
+
+    };
+
+}
@@ -0,0 +1,288 @@
+#pragma once
+#include <WinSock2.h>
+#include <MSTcpIP.h>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+
+namespace tinySocket {
+
+    struct SocketStatistics {
+        ULONGLONG bytes_sent;
+        ULONGLONG bytes_received;
+        ULONGLONG send_calls;
+        ULONGLONG receive_calls;
+        ULONGLONG would_block;
+        ULONGLONG short_writes;
+        ULONGLONG short_reads;
+        ULONGLONG errors;
+    };
+
+    class Instrumentation {
+    private:
+
+        struct Counters {
+            std::atomic<ULONGLONG> bytes_sent;
+            std::atomic<ULONGLONG> bytes_received;
+            std::atomic<ULONGLONG> send_calls;
+            std::atomic<ULONGLONG> receive_calls;
+            std::atomic<ULONGLONG> would_block;
+            std::atomic<ULONGLONG> short_writes;
+            std::atomic<ULONGLONG> short_reads;
+            std::atomic<ULONGLONG> errors;
+
+            Counters() : bytes_sent(0), bytes_received(0), send_calls(0), receive_calls(0),
+                         would_block(0), short_writes(0), short_reads(0), errors(0) { }
+        };
+
+        struct ThreadBlock {
+            std::mutex mutex;
+            std::unordered_map<SOCKET, Counters> counters;
+            // Bumped by Forget so the owning thread drops its cached entry.
+            std::atomic<ULONG> generation;
+
+            ThreadBlock() : generation(0) { }
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadBlock>> threads;
+            // Totals of threads that have exited, so their traffic is not lost.
+            std::unordered_map<SOCKET, SocketStatistics> retired;
+        };
+
+        // Registers the calling thread's block on first use and folds it into
+        // the registry's retired totals when the thread exits.
+        struct ThreadState {
+            std::shared_ptr<ThreadBlock> block;
+            SOCKET last_descriptor;
+            Counters* last_counters;
+            ULONG last_generation;
+
+            ThreadState() : last_descriptor(INVALID_SOCKET), last_counters(nullptr), last_generation(0) { }
+
+            ~ThreadState() {
+                if (!block)
+                    return;
+                Registry& registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                {
+                    std::lock_guard<std::mutex> block_lock(block->mutex);
+                    for (const auto& it : block->counters)
+                        Accumulate(registry.retired[it.first], it.second);
+                }
+                for (size_t i = 0; i < registry.threads.size(); ++i) {
+                    if (registry.threads[i] == block) {
+                        registry.threads[i] = registry.threads.back();
+                        registry.threads.pop_back();
+                        break;
+                    }
+                }
+            }
+        };
+
+        static Registry& GetRegistry() {
+            static Registry registry;
+            return registry;
+        }
+
+        static std::atomic<bool>& GetEnabled() {
+            static std::atomic<bool> enabled(false);
+            return enabled;
+        }
+
+        static void Accumulate(SocketStatistics& statistics, const Counters& counters) {
+            statistics.bytes_sent += counters.bytes_sent;
+            statistics.bytes_received += counters.bytes_received;
+            statistics.send_calls += counters.send_calls;
+            statistics.receive_calls += counters.receive_calls;
+            statistics.would_block += counters.would_block;
+            statistics.short_writes += counters.short_writes;
+            statistics.short_reads += counters.short_reads;
+            statistics.errors += counters.errors;
+        }
+
+        static void Accumulate(SocketStatistics& statistics, const SocketStatistics& other) {
+            statistics.bytes_sent += other.bytes_sent;
+            statistics.bytes_received += other.bytes_received;
+            statistics.send_calls += other.send_calls;
+            statistics.receive_calls += other.receive_calls;
+            statistics.would_block += other.would_block;
+            statistics.short_writes += other.short_writes;
+            statistics.short_reads += other.short_reads;
+            statistics.errors += other.errors;
+        }
+
+        static Counters& Lookup(SOCKET descriptor) {
+            // Registry is constructed first so it outlives every ThreadState.
+            GetRegistry();
+            thread_local ThreadState state;
+
+            if (!state.block) {
+                state.block = std::make_shared<ThreadBlock>();
+                Registry& registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.threads.push_back(state.block);
+            }
+
+            ThreadBlock& block = *state.block;
+            ULONG generation = block.generation.load(std::memory_order_acquire);
+            if (descriptor == state.last_descriptor && generation == state.last_generation)
+                return *state.last_counters;
+
+            std::lock_guard<std::mutex> lock(block.mutex);
+            auto it = block.counters.find(descriptor);
+            if (it == block.counters.end())
+                it = block.counters.emplace(std::piecewise_construct,
+                                            std::forward_as_tuple(descriptor),
+                                            std::forward_as_tuple()).first;
+            state.last_descriptor = descriptor;
+            state.last_counters = &it->second;
+            state.last_generation = block.generation.load(std::memory_order_relaxed);
+            return it->second;
+        }
+
+        static void Add(std::atomic<ULONGLONG>& counter, ULONGLONG value) {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        static void Record(SOCKET descriptor, bool send, ULONGLONG requested, int result, DWORD error) {
+            Counters& counters = Lookup(descriptor);
+            Add(send ? counters.send_calls : counters.receive_calls, 1);
+            if (error != 0) {
+                Add(error == WSAEWOULDBLOCK ? counters.would_block : counters.errors, 1);
+                return;
+            }
+            Add(send ? counters.bytes_sent : counters.bytes_received, static_cast<ULONGLONG>(result));
+            if (static_cast<ULONGLONG>(result) < requested)
+                Add(send ? counters.short_writes : counters.short_reads, 1);
+        }
+
+        static bool QueryTcpInfo(SOCKET descriptor, TCP_INFO_v0& info) {
+            DWORD version = 0;
+            DWORD bytes = 0;
+            return ::WSAIoctl(descriptor, SIO_TCP_INFO, &version, sizeof(version),
+                              &info, sizeof(info), &bytes, nullptr, nullptr) == 0;
+        }
+
+    public:
+
+        // A single process-wide switch, off by default. Counting can be turned
+        // on or off at any time; sockets keep whatever they recorded so far.
+        static bool IsEnabled() {
+            return GetEnabled().load(std::memory_order_relaxed);
+        }
+
+        static void SetEnabled(bool enabled) {
+            GetEnabled().store(enabled, std::memory_order_relaxed);
+        }
+
+        static ULONGLONG Length(const WSABUF* buffers, int count) {
+            ULONGLONG length = 0;
+            if (IsEnabled()) {
+                for (int i = 0; i < count; ++i)
+                    length += buffers[i].len;
+            }
+            return length;
+        }
+
+        static void RecordSend(SOCKET descriptor, ULONGLONG requested, int result, DWORD error) {
+            if (IsEnabled())
+                Record(descriptor, true, requested, result, error);
+        }
+
+        static void RecordReceive(SOCKET descriptor, ULONGLONG requested, int result, DWORD error) {
+            if (IsEnabled())
+                Record(descriptor, false, requested, result, error);
+        }
+
+        // Called when a socket is closed, after the last send or receive on it
+        // has returned; the descriptor value may be reused by a new socket.
+        static void Forget(SOCKET descriptor) {
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.retired.erase(descriptor);
+            for (const std::shared_ptr<ThreadBlock>& block : registry.threads) {
+                std::lock_guard<std::mutex> block_lock(block->mutex);
+                if (block->counters.erase(descriptor) != 0)
+                    block->generation.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        static std::map<SOCKET, SocketStatistics> Snapshot() {
+            std::map<SOCKET, SocketStatistics> snapshot;
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (const auto& it : registry.retired)
+                Accumulate(snapshot[it.first], it.second);
+            for (const std::shared_ptr<ThreadBlock>& block : registry.threads) {
+                std::lock_guard<std::mutex> block_lock(block->mutex);
+                for (const auto& it : block->counters)
+                    Accumulate(snapshot[it.first], it.second);
+            }
+            return snapshot;
+        }
+
+        static std::string DumpText() {
+            std::ostringstream out;
+            for (const auto& it : Snapshot()) {
+                const SocketStatistics& s = it.second;
+                out << "socket " << it.first
+                    << " sent " << s.bytes_sent << "B/" << s.send_calls
+                    << " received " << s.bytes_received << "B/" << s.receive_calls
+                    << " would_block " << s.would_block
+                    << " short_writes " << s.short_writes
+                    << " short_reads " << s.short_reads
+                    << " errors " << s.errors;
+
+                TCP_INFO_v0 info;
+                if (QueryTcpInfo(it.first, info))
+                    out << " rtt_us " << info.RttUs
+                        << " cwnd " << info.Cwnd
+                        << " in_flight " << info.BytesInFlight
+                        << " retrans " << info.BytesRetrans;
+                out << '\n';
+            }
+            return out.str();
+        }
+
+        static std::string DumpJson() {
+            std::ostringstream out;
+            out << "{\"sockets\":[";
+            bool first = true;
+            for (const auto& it : Snapshot()) {
+                const SocketStatistics& s = it.second;
+                out << (first ? "" : ",")
+                    << "{\"socket\":" << it.first
+                    << ",\"bytes_sent\":" << s.bytes_sent
+                    << ",\"bytes_received\":" << s.bytes_received
+                    << ",\"send_calls\":" << s.send_calls
+                    << ",\"receive_calls\":" << s.receive_calls
+                    << ",\"would_block\":" << s.would_block
+                    << ",\"short_writes\":" << s.short_writes
+                    << ",\"short_reads\":" << s.short_reads
+                    << ",\"errors\":" << s.errors;
+
+                TCP_INFO_v0 info;
+                if (QueryTcpInfo(it.first, info))
+                    out << ",\"tcp\":{\"rtt_us\":" << info.RttUs
+                        << ",\"min_rtt_us\":" << info.MinRttUs
+                        << ",\"cwnd\":" << info.Cwnd
+                        << ",\"bytes_in_flight\":" << info.BytesInFlight
+                        << ",\"bytes_retransmitted\":" << info.BytesRetrans
+                        << ",\"timeout_episodes\":" << info.TimeoutEpisodes << "}";
+                out << "}";
+                first = false;
+            }
+            out << "]}";
+            return out.str();
+        }
+
+    };
+
+}
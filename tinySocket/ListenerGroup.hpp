@@ -0,0 +1,302 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "UDPSocket.hpp"
+#include "TuningProfile.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+
+namespace tinySocket {
+
+    inline void PinCurrentThread(size_t core) throw(DWORD) {
+        size_t cores = std::thread::hardware_concurrency();
+        if (cores == 0 || cores > sizeof(DWORD_PTR) * 8)
+            cores = sizeof(DWORD_PTR) * 8;
+        DWORD_PTR mask = static_cast<DWORD_PTR>(1) << (core % cores);
+        if (::SetThreadAffinityMask(::GetCurrentThread(), mask) == 0)
+            throw ::GetLastError();
+    }
+
+    const DWORD MaxAcceptBackoff = 100;
+
+    // Called on the worker thread with errors that do not stop the worker: a
+    // failed pin, a tuning profile that could not be applied (the connection is
+    // dropped) or a handler that threw. Exceptions other than DWORD are reported
+    // as ERROR_UNHANDLED_EXCEPTION.
+    typedef std::function<void(size_t, DWORD)> WorkerErrorHandler;
+
+    inline void ReportWorkerError(const WorkerErrorHandler& handler, size_t worker, DWORD error) {
+        if (!handler)
+            return;
+        try {
+            handler(worker, error);
+        } catch (...) {
+        }
+    }
+
+    inline void TryPinCurrentThread(const WorkerErrorHandler& handler, size_t worker) {
+        try {
+            PinCurrentThread(worker);
+        } catch (DWORD error) {
+            ReportWorkerError(handler, worker, error);
+        }
+    }
+
+    // Sleeps after a failed accept or receive so that a persistent error
+    // (WSAEMFILE, WSAENOBUFS) does not spin every worker at 100% CPU.
+    inline DWORD BackOff(DWORD delay) {
+        delay = delay == 0 ? 1 : (delay * 2 < MaxAcceptBackoff ? delay * 2 : MaxAcceptBackoff);
+        ::Sleep(delay);
+        return delay;
+    }
+
+    inline SocketAddr<AF_INET> LoopbackOf(SocketAddr<AF_INET> address) {
+        if (address.sin_addr.s_addr == htonl(INADDR_ANY))
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return address;
+    }
+
+    inline SocketAddr<AF_INET6> LoopbackOf(SocketAddr<AF_INET6> address) {
+        if (IN6_IS_ADDR_UNSPECIFIED(&address.sin6_addr))
+            address.sin6_addr = in6addr_loopback;
+        return address;
+    }
+
+    template<int _AF>
+    class TCPListenerGroup {
+    public:
+
+        typedef std::function<void(size_t, TCPCommunicateSocket<_AF>)> Handler;
+
+    private:
+
+        TCPListenSocket<_AF> _listener;
+        TuningProfile _profile;
+        WorkerErrorHandler _error_handler;
+        std::vector<std::thread> _workers;
+        std::atomic<bool> _stopped;
+
+        void Work(size_t worker, bool pin, const Handler& handler) {
+            if (pin)
+                TryPinCurrentThread(_error_handler, worker);
+
+            DWORD backoff = 0;
+            while (!_stopped.load(std::memory_order_acquire)) {
+                auto accepted = _listener.TryAccept();
+                if (_stopped.load(std::memory_order_acquire))
+                    break;
+                if (!accepted) {
+                    DWORD error = accepted.GetError();
+                    if (error == WSAENOTSOCK || error == WSAEINTR)
+                        break;
+                    backoff = BackOff(backoff);
+                    continue;
+                }
+                backoff = 0;
+                try {
+                    _profile.Apply(accepted.Value());
+                } catch (DWORD error) {
+                    ReportWorkerError(_error_handler, worker, error);
+                    continue;
+                }
+                try {
+                    handler(worker, std::move(accepted.Value()));
+                } catch (DWORD error) {
+                    ReportWorkerError(_error_handler, worker, error);
+                } catch (...) {
+                    ReportWorkerError(_error_handler, worker, ERROR_UNHANDLED_EXCEPTION);
+                }
+            }
+        }
+
+    public:
+
+        TCPListenerGroup(const TCHAR* LocalAddress, u_short LocalPort, int backlog) throw(DWORD) : _stopped(true) {
+            _listener.SetReuseAddress(true);
+            _listener.Bind(LocalAddress, LocalPort);
+            _listener.Listen(backlog);
+        }
+
+        TCPListenerGroup(const TCPListenerGroup<_AF>&) = delete;
+
+        TCPListenerGroup<_AF>& operator=(const TCPListenerGroup<_AF>&) = delete;
+
+        ~TCPListenerGroup() {
+            Stop();
+        }
+
+        const TCPListenSocket<_AF>& GetListener() const {
+            return _listener;
+        }
+
+        // Workers read the profile without a lock, so it can only be set before Start.
+        void SetProfile(const TuningProfile& profile) throw(DWORD) {
+            if (!_workers.empty())
+                throw WSAEINVAL;
+            _profile = profile;
+        }
+
+        void SetErrorHandler(WorkerErrorHandler handler) throw(DWORD) {
+            if (!_workers.empty())
+                throw WSAEINVAL;
+            _error_handler = std::move(handler);
+        }
+
+        void Start(size_t workers, Handler handler, bool pin = true) {
+            _stopped = false;
+            for (size_t i = 0; i < workers; ++i)
+                _workers.emplace_back([this, i, pin, handler]() {
+                    try {
+                        Work(i, pin, handler);
+                    } catch (...) {
+                        ReportWorkerError(_error_handler, i, ERROR_UNHANDLED_EXCEPTION);
+                    }
+                });
+        }
+
+        void Stop() {
+            if (_stopped.exchange(true))
+                return;
+
+            // One loopback connection per worker wakes every blocked accept; the
+            // listener is only closed once no worker can still be inside it.
+            std::vector<TCPCommunicateSocket<_AF>> wakers;
+            try {
+                SocketAddr<_AF> address = LoopbackOf(_listener.GetSocketName());
+                for (size_t i = 0; i < _workers.size(); ++i) {
+                    wakers.emplace_back();
+                    wakers.back().Connect(address);
+                }
+            } catch (DWORD) {
+                try {
+                    _listener.Close();
+                } catch (DWORD) {
+                }
+            }
+            for (std::thread& worker : _workers)
+                worker.join();
+            _workers.clear();
+            try {
+                if (_listener.GetDescriptor() != INVALID_SOCKET)
+                    _listener.Close();
+            } catch (DWORD) {
+            }
+        }
+
+    };
+
+    template<int _AF>
+    class UDPReceiverGroup {
+    public:
+
+        typedef std::function<void(size_t, const UDPSocket<_AF>&, const char*, const typename UDPSocket<_AF>::ReceiveInfo&)> Handler;
+
+    private:
+
+        UDPSocket<_AF> _socket;
+        WorkerErrorHandler _error_handler;
+        std::vector<std::thread> _workers;
+        std::atomic<bool> _stopped;
+
+        void Work(size_t worker, bool pin, int buffer_size, const Handler& handler) {
+            if (pin)
+                TryPinCurrentThread(_error_handler, worker);
+
+            std::vector<char> buffer(buffer_size);
+            DWORD backoff = 0;
+            while (!_stopped.load(std::memory_order_acquire)) {
+                auto received = _socket.TryReceiveFrom(buffer.data(), buffer_size);
+                if (_stopped.load(std::memory_order_acquire))
+                    break;
+                if (!received) {
+                    DWORD error = received.GetError();
+                    if (error == WSAENOTSOCK || error == WSAEINTR)
+                        break;
+                    if (error != WSAECONNRESET && error != WSAEMSGSIZE)
+                        backoff = BackOff(backoff);
+                    continue;
+                }
+                backoff = 0;
+                try {
+                    handler(worker, _socket, buffer.data(), received.Value());
+                } catch (DWORD error) {
+                    ReportWorkerError(_error_handler, worker, error);
+                } catch (...) {
+                    ReportWorkerError(_error_handler, worker, ERROR_UNHANDLED_EXCEPTION);
+                }
+            }
+        }
+
+    public:
+
+        UDPReceiverGroup(const TCHAR* LocalAddress, u_short LocalPort) throw(DWORD) : _stopped(true) {
+            _socket.Bind(LocalAddress, LocalPort);
+        }
+
+        UDPReceiverGroup(const UDPReceiverGroup<_AF>&) = delete;
+
+        UDPReceiverGroup<_AF>& operator=(const UDPReceiverGroup<_AF>&) = delete;
+
+        ~UDPReceiverGroup() {
+            Stop();
+        }
+
+        const UDPSocket<_AF>& GetSocket() const {
+            return _socket;
+        }
+
+        void SetProfile(const TuningProfile& profile) throw(DWORD) {
+            if (!_workers.empty())
+                throw WSAEINVAL;
+            profile.Apply(_socket);
+        }
+
+        void SetErrorHandler(WorkerErrorHandler handler) throw(DWORD) {
+            if (!_workers.empty())
+                throw WSAEINVAL;
+            _error_handler = std::move(handler);
+        }
+
+        void Start(size_t workers, Handler handler, int buffer_size = 65536, bool pin = true) {
+            _stopped = false;
+            for (size_t i = 0; i < workers; ++i)
+                _workers.emplace_back([this, i, pin, buffer_size, handler]() {
+                    try {
+                        Work(i, pin, buffer_size, handler);
+                    } catch (...) {
+                        ReportWorkerError(_error_handler, i, ERROR_UNHANDLED_EXCEPTION);
+                    }
+                });
+        }
+
+        void Stop() {
+            if (_stopped.exchange(true))
+                return;
+
+            // As for TCPListenerGroup: wake every blocked receive with an empty
+            // datagram, and close the socket only after the workers have exited.
+            try {
+                UDPSocket<_AF> waker;
+                SocketAddr<_AF> address = LoopbackOf(_socket.GetSocketName());
+                for (size_t i = 0; i < _workers.size(); ++i)
+                    waker.SendTo(nullptr, 0, address);
+            } catch (DWORD) {
+                try {
+                    _socket.Close();
+                } catch (DWORD) {
+                }
+            }
+            for (std::thread& worker : _workers)
+                worker.join();
+            _workers.clear();
+            try {
+                if (_socket.GetDescriptor() != INVALID_SOCKET)
+                    _socket.Close();
+            } catch (DWORD) {
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,905 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "UDPSocket.hpp"
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+
+#pragma comment(lib, "Synchronization.lib")
+
+namespace tinySocket {
+
+    //----------------------------
+    //  Clock
+    //----------------------------
+
+    inline ULONGLONG MemoryClockFrequency() {
+        static const ULONGLONG frequency = []() {
+            LARGE_INTEGER value;
+            ::QueryPerformanceFrequency(&value);
+            return static_cast<ULONGLONG>(value.QuadPart);
+        }();
+        return frequency;
+    }
+
+    inline ULONGLONG MemoryClockNow() {
+        LARGE_INTEGER counter;
+        ::QueryPerformanceCounter(&counter);
+        return static_cast<ULONGLONG>(counter.QuadPart);
+    }
+
+    inline DWORD MemoryClockMilliseconds(ULONGLONG ticks) {
+        ULONGLONG frequency = MemoryClockFrequency();
+        ULONGLONG milliseconds = ticks / frequency * 1000 + (ticks % frequency * 1000 + frequency - 1) / frequency;
+        return milliseconds >= INFINITE ? INFINITE - 1 : static_cast<DWORD>(milliseconds);
+    }
+
+    //----------------------------
+    //  Link impairment
+    //----------------------------
+
+    struct LinkProfile {
+        ULONGLONG latency_us;
+        ULONGLONG bandwidth;
+        double loss;
+    };
+
+    class MemoryLink {
+    private:
+        LinkProfile _profile;
+        ULONGLONG _latency;
+        ULONGLONG _next_free;
+        ULONGLONG _random;
+
+    public:
+
+        MemoryLink() : _profile(), _latency(0), _next_free(0), _random(0x9E3779B97F4A7C15ULL) { }
+
+        void SetProfile(const LinkProfile& profile, ULONGLONG seed = 0x9E3779B97F4A7C15ULL) {
+            ULONGLONG frequency = MemoryClockFrequency();
+            _profile = profile;
+            _latency = profile.latency_us / 1000000 * frequency + profile.latency_us % 1000000 * frequency / 1000000;
+            _next_free = 0;
+            _random = seed != 0 ? seed : 1;
+        }
+
+        const LinkProfile& GetProfile() const {
+            return _profile;
+        }
+
+        bool Lose() {
+            if (_profile.loss <= 0)
+                return false;
+            _random ^= _random << 13;
+            _random ^= _random >> 7;
+            _random ^= _random << 17;
+            return static_cast<double>(_random >> 11) / 9007199254740992.0 < _profile.loss;
+        }
+
+        ULONGLONG Schedule(size_t length) {
+            ULONGLONG now = MemoryClockNow();
+            if (_profile.bandwidth == 0)
+                return now + _latency;
+            ULONGLONG start = _next_free > now ? _next_free : now;
+            _next_free = start + static_cast<ULONGLONG>(length) * MemoryClockFrequency() / _profile.bandwidth;
+            return _next_free + _latency;
+        }
+
+    };
+
+    //----------------------------
+    //  SPSC ring
+    //----------------------------
+
+    class MemoryRing {
+    private:
+        std::unique_ptr<char[]> _data;
+        size_t _capacity;
+        alignas(64) std::atomic<ULONGLONG> _head;
+        alignas(64) std::atomic<ULONGLONG> _tail;
+        alignas(64) std::atomic<ULONG> _sequence;
+        std::atomic<LONG> _waiters;
+        std::atomic<bool> _writer_closed;
+        std::atomic<bool> _reader_closed;
+
+        void CopyIn(ULONGLONG position, const void* data, size_t length) {
+            size_t offset = static_cast<size_t>(position & (_capacity - 1));
+            size_t first = length < _capacity - offset ? length : _capacity - offset;
+            memcpy(_data.get() + offset, data, first);
+            memcpy(_data.get(), reinterpret_cast<const char*>(data) + first, length - first);
+        }
+
+        void CopyOut(ULONGLONG position, void* data, size_t length) const {
+            size_t offset = static_cast<size_t>(position & (_capacity - 1));
+            size_t first = length < _capacity - offset ? length : _capacity - offset;
+            memcpy(data, _data.get() + offset, first);
+            memcpy(reinterpret_cast<char*>(data) + first, _data.get(), length - first);
+        }
+
+        // Only enters the kernel when a reader or writer is parked in Wait. The
+        // seq_cst pair with Wait means a waiter either sees the new sequence or
+        // is counted before the check here.
+        void Signal() {
+            _sequence.fetch_add(1, std::memory_order_seq_cst);
+            if (_waiters.load(std::memory_order_seq_cst) != 0)
+                ::WakeByAddressAll(&_sequence);
+        }
+
+    public:
+
+        MemoryRing(size_t capacity) : _capacity(64), _head(0), _tail(0), _sequence(0), _waiters(0),
+                                      _writer_closed(false), _reader_closed(false) {
+            while (_capacity < capacity)
+                _capacity <<= 1;
+            _data.reset(new char[_capacity]);
+        }
+
+        MemoryRing(const MemoryRing&) = delete;
+
+        MemoryRing& operator=(const MemoryRing&) = delete;
+
+        size_t GetCapacity() const {
+            return _capacity;
+        }
+
+        size_t GetWritable() const {
+            return _capacity - static_cast<size_t>(_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+        }
+
+        bool Push(const void* header, size_t header_size, const void* data, size_t length) {
+            ULONGLONG head = _head.load(std::memory_order_relaxed);
+            if (GetWritable() < header_size + length)
+                return false;
+            CopyIn(head, header, header_size);
+            CopyIn(head + header_size, data, length);
+            _head.store(head + header_size + length, std::memory_order_release);
+            Signal();
+            return true;
+        }
+
+        bool Peek(void* header, size_t header_size) const {
+            ULONGLONG tail = _tail.load(std::memory_order_relaxed);
+            if (_head.load(std::memory_order_acquire) - tail < header_size)
+                return false;
+            CopyOut(tail, header, header_size);
+            return true;
+        }
+
+        void Read(void* data, size_t length) const {
+            CopyOut(_tail.load(std::memory_order_relaxed), data, length);
+        }
+
+        void Release(size_t length) {
+            _tail.store(_tail.load(std::memory_order_relaxed) + length, std::memory_order_release);
+            Signal();
+        }
+
+        ULONG GetSequence() const {
+            return _sequence.load(std::memory_order_acquire);
+        }
+
+        void Wait(ULONG observed, DWORD timeout) {
+            _waiters.fetch_add(1, std::memory_order_seq_cst);
+            ::WaitOnAddress(&_sequence, &observed, sizeof(observed), timeout);
+            _waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void CloseWriter() {
+            _writer_closed.store(true, std::memory_order_release);
+            Signal();
+        }
+
+        void CloseReader() {
+            _reader_closed.store(true, std::memory_order_release);
+            Signal();
+        }
+
+        bool IsWriterClosed() const {
+            return _writer_closed.load(std::memory_order_acquire);
+        }
+
+        bool IsReaderClosed() const {
+            return _reader_closed.load(std::memory_order_acquire);
+        }
+
+    };
+
+    struct MemoryStream {
+        MemoryRing forward;
+        MemoryRing backward;
+        std::mutex forward_producers;
+        std::mutex backward_producers;
+
+        MemoryStream(size_t capacity) : forward(capacity), backward(capacity) { }
+    };
+
+    template<int _AF>
+    struct MemoryDatagramQueue {
+        MemoryRing ring;
+        std::mutex producers;
+
+        MemoryDatagramQueue(size_t capacity) : ring(capacity) { }
+    };
+
+    //----------------------------
+    //  Network
+    //----------------------------
+
+    inline std::string MemoryKey(const SocketAddr<AF_INET>& address, bool wildcard) {
+        IN_ADDR host = { };
+        if (!wildcard)
+            host = address.sin_addr;
+        return std::string(reinterpret_cast<const char*>(&host), sizeof(host)) +
+               std::string(reinterpret_cast<const char*>(&address.sin_port), sizeof(address.sin_port));
+    }
+
+    inline std::string MemoryKey(const SocketAddr<AF_INET6>& address, bool wildcard) {
+        IN6_ADDR host = { };
+        if (!wildcard)
+            host = address.sin6_addr;
+        return std::string(reinterpret_cast<const char*>(&host), sizeof(host)) +
+               std::string(reinterpret_cast<const char*>(&address.sin6_port), sizeof(address.sin6_port));
+    }
+
+    inline u_short GetAddressPort(const SocketAddr<AF_INET>& address) {
+        return ntohs(address.sin_port);
+    }
+
+    inline u_short GetAddressPort(const SocketAddr<AF_INET6>& address) {
+        return ntohs(address.sin6_port);
+    }
+
+    template<int _AF>
+    class MemoryCommunicateSocket;
+
+    template<int _AF>
+    class MemoryNetwork {
+    public:
+
+        struct Backlog {
+            std::mutex mutex;
+            std::condition_variable ready;
+            std::deque<MemoryCommunicateSocket<_AF>> pending;
+            int limit;
+            bool closed;
+        };
+
+    private:
+        std::mutex _mutex;
+        std::map<std::string, std::shared_ptr<Backlog>> _listeners;
+        std::map<std::string, std::shared_ptr<MemoryDatagramQueue<_AF>>> _datagrams;
+        u_short _next_port;
+        size_t _ring_size;
+
+        template<typename _Ty>
+        void Insert(std::map<std::string, std::shared_ptr<_Ty>>& table, SocketAddr<_AF>& address,
+                    const std::shared_ptr<_Ty>& value) throw(DWORD) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (GetAddressPort(address) == 0) {
+                for (int attempts = 0; ; ++attempts) {
+                    if (attempts == 16384)
+                        throw WSAEADDRINUSE;
+                    u_short port = _next_port;
+                    _next_port = _next_port == 65535 ? 49152 : _next_port + 1;
+                    SetAddressPort(address, port);
+                    if (table.find(MemoryKey(address, false)) == table.end())
+                        break;
+                }
+            }
+            if (!table.emplace(MemoryKey(address, false), value).second)
+                throw WSAEADDRINUSE;
+        }
+
+        template<typename _Ty>
+        std::shared_ptr<_Ty> Find(const std::map<std::string, std::shared_ptr<_Ty>>& table, const SocketAddr<_AF>& address) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = table.find(MemoryKey(address, false));
+            if (it == table.end())
+                it = table.find(MemoryKey(address, true));
+            return it == table.end() ? nullptr : it->second;
+        }
+
+        template<typename _Ty>
+        void Erase(std::map<std::string, std::shared_ptr<_Ty>>& table, const SocketAddr<_AF>& address) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            table.erase(MemoryKey(address, false));
+        }
+
+    public:
+
+        MemoryNetwork(size_t ring_size = 256 * 1024) : _next_port(49152), _ring_size(ring_size) { }
+
+        MemoryNetwork(const MemoryNetwork<_AF>&) = delete;
+
+        MemoryNetwork<_AF>& operator=(const MemoryNetwork<_AF>&) = delete;
+
+        static MemoryNetwork<_AF>& Default() {
+            static MemoryNetwork<_AF> network;
+            return network;
+        }
+
+        size_t GetRingSize() const {
+            return _ring_size;
+        }
+
+        void SetRingSize(size_t ring_size) {
+            _ring_size = ring_size;
+        }
+
+        void BindListener(SocketAddr<_AF>& address, const std::shared_ptr<Backlog>& backlog) throw(DWORD) {
+            Insert(_listeners, address, backlog);
+        }
+
+        void BindDatagram(SocketAddr<_AF>& address, const std::shared_ptr<MemoryDatagramQueue<_AF>>& queue) throw(DWORD) {
+            Insert(_datagrams, address, queue);
+        }
+
+        std::shared_ptr<Backlog> FindListener(const SocketAddr<_AF>& address) {
+            return Find(_listeners, address);
+        }
+
+        std::shared_ptr<MemoryDatagramQueue<_AF>> FindDatagram(const SocketAddr<_AF>& address) {
+            return Find(_datagrams, address);
+        }
+
+        void UnbindListener(const SocketAddr<_AF>& address) {
+            Erase(_listeners, address);
+        }
+
+        void UnbindDatagram(const SocketAddr<_AF>& address) {
+            Erase(_datagrams, address);
+        }
+
+        u_short AllocatePort() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            u_short port = _next_port;
+            _next_port = _next_port == 65535 ? 49152 : _next_port + 1;
+            return port;
+        }
+
+    };
+
+    //----------------------------
+    //  Stream sockets
+    //----------------------------
+
+    template<int _AF>
+    class MemoryListenSocket;
+
+    template<int _AF>
+    class MemoryCommunicateSocket {
+        friend class MemoryListenSocket<_AF>;
+    private:
+
+        struct Record {
+            ULONGLONG deliver_at;
+            ULONGLONG length;
+        };
+
+        MemoryNetwork<_AF>* _network;
+        std::shared_ptr<MemoryStream> _stream;
+        MemoryRing* _out;
+        MemoryRing* _in;
+        std::mutex* _producers;
+        SocketAddr<_AF> _local;
+        SocketAddr<_AF> _peer;
+        mutable MemoryLink _link;
+        mutable size_t _remaining;
+        bool _nonblocking;
+
+        void Attach(const std::shared_ptr<MemoryStream>& stream, bool accepted,
+                    const SocketAddr<_AF>& local, const SocketAddr<_AF>& peer) {
+            _stream = stream;
+            _out = accepted ? &stream->backward : &stream->forward;
+            _in = accepted ? &stream->forward : &stream->backward;
+            _producers = accepted ? &stream->backward_producers : &stream->forward_producers;
+            _local = local;
+            _peer = peer;
+            _remaining = 0;
+        }
+
+    public:
+
+        MemoryCommunicateSocket(MemoryNetwork<_AF>& network = MemoryNetwork<_AF>::Default()) :
+            _network(&network), _out(nullptr), _in(nullptr), _producers(nullptr), _local(), _peer(), _remaining(0), _nonblocking(false) { }
+
+        MemoryCommunicateSocket(const MemoryCommunicateSocket<_AF>&) = delete;
+
+        MemoryCommunicateSocket(MemoryCommunicateSocket<_AF>&& other) :
+            _network(other._network), _stream(std::move(other._stream)), _out(other._out), _in(other._in),
+            _producers(other._producers), _local(other._local), _peer(other._peer), _link(other._link),
+            _remaining(other._remaining), _nonblocking(other._nonblocking) {
+            other._out = nullptr;
+            other._in = nullptr;
+        }
+
+        MemoryCommunicateSocket<_AF>& operator=(const MemoryCommunicateSocket<_AF>&) = delete;
+
+        MemoryCommunicateSocket<_AF>& operator=(MemoryCommunicateSocket<_AF>&& other) {
+            if (this != &other) {
+                Close();
+                _network = other._network;
+                _stream = std::move(other._stream);
+                _out = other._out;
+                _in = other._in;
+                _producers = other._producers;
+                _local = other._local;
+                _peer = other._peer;
+                _link = other._link;
+                _remaining = other._remaining;
+                _nonblocking = other._nonblocking;
+                other._out = nullptr;
+                other._in = nullptr;
+            }
+            return *this;
+        }
+
+        ~MemoryCommunicateSocket() {
+            Close();
+        }
+
+        void Close() {
+            if (!_stream)
+                return;
+            _out->CloseWriter();
+            _in->CloseReader();
+            _stream.reset();
+            _out = nullptr;
+            _in = nullptr;
+            _producers = nullptr;
+        }
+
+        void SetNonBlocking(bool enable) {
+            _nonblocking = enable;
+        }
+
+        template<typename _Option>
+        void SetOption(const typename _Option::ValueType&) const { }
+
+        void SetLinkProfile(const LinkProfile& profile, ULONGLONG seed = 0x9E3779B97F4A7C15ULL) {
+            _link.SetProfile(profile, seed);
+        }
+
+        SocketAddr<_AF> GetSocketName() const {
+            return _local;
+        }
+
+        SocketAddr<_AF> GetPeerName() const {
+            return _peer;
+        }
+
+        void Connect(const SocketAddr<_AF>& to) throw(DWORD) {
+            std::shared_ptr<typename MemoryNetwork<_AF>::Backlog> backlog = _network->FindListener(to);
+            if (!backlog)
+                throw WSAECONNREFUSED;
+
+            std::shared_ptr<MemoryStream> stream = std::make_shared<MemoryStream>(_network->GetRingSize());
+            SocketAddr<_AF> local = to;
+            SetAddressPort(local, _network->AllocatePort());
+
+            MemoryCommunicateSocket<_AF> accepted(*_network);
+            accepted.Attach(stream, true, to, local);
+            {
+                std::lock_guard<std::mutex> lock(backlog->mutex);
+                if (backlog->closed || static_cast<int>(backlog->pending.size()) >= backlog->limit)
+                    throw WSAECONNREFUSED;
+                backlog->pending.push_back(std::move(accepted));
+            }
+            backlog->ready.notify_one();
+
+            Close();
+            Attach(stream, false, local, to);
+        }
+
+        // Sends may come from several threads: the ring has a single producer
+        // slot, so each chunk and its link schedule are pushed under the
+        // stream's producer lock. Receives must stay on one thread at a time.
+        Result<int> TrySend(const void* buffer, int length, int flag = 0) const {
+            if (!_stream)
+                return Result<int>::Error(WSAENOTCONN);
+
+            for (;;) {
+                if (_out->IsReaderClosed())
+                    return Result<int>::Error(WSAECONNRESET);
+
+                ULONG sequence = _out->GetSequence();
+                {
+                    std::lock_guard<std::mutex> lock(*_producers);
+                    size_t writable = _out->GetWritable();
+                    if (writable > sizeof(Record)) {
+                        size_t chunk = static_cast<size_t>(length) < writable - sizeof(Record) ?
+                                       static_cast<size_t>(length) : writable - sizeof(Record);
+                        Record record = { _link.Schedule(chunk), chunk };
+                        _out->Push(&record, sizeof(record), buffer, chunk);
+                        return static_cast<int>(chunk);
+                    }
+                }
+                if (_nonblocking)
+                    return Result<int>::Error(WSAEWOULDBLOCK);
+                _out->Wait(sequence, INFINITE);
+            }
+        }
+
+        Result<int> TryReceive(void* buffer, int length, int flag = 0) const {
+            if (!_stream)
+                return Result<int>::Error(WSAENOTCONN);
+
+            char* data = reinterpret_cast<char*>(buffer);
+            for (;;) {
+                ULONG sequence = _in->GetSequence();
+                bool closed = _in->IsWriterClosed();
+                DWORD timeout = INFINITE;
+                bool empty = false;
+                int received = 0;
+                while (received < length) {
+                    if (_remaining == 0) {
+                        Record record;
+                        if (!_in->Peek(&record, sizeof(record))) {
+                            empty = true;
+                            break;
+                        }
+                        ULONGLONG now = MemoryClockNow();
+                        if (record.deliver_at > now) {
+                            timeout = MemoryClockMilliseconds(record.deliver_at - now);
+                            break;
+                        }
+                        _in->Release(sizeof(record));
+                        _remaining = static_cast<size_t>(record.length);
+                    }
+
+                    size_t chunk = _remaining < static_cast<size_t>(length - received) ?
+                                   _remaining : static_cast<size_t>(length - received);
+                    _in->Read(data + received, chunk);
+                    _in->Release(chunk);
+                    _remaining -= chunk;
+                    received += static_cast<int>(chunk);
+                }
+
+                if (received > 0 || length == 0)
+                    return received;
+                if (closed && empty)
+                    return 0;
+                if (_nonblocking)
+                    return Result<int>::Error(WSAEWOULDBLOCK);
+                _in->Wait(sequence, timeout);
+            }
+        }
+
+        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TrySend(buffer, length, flag).Value();
+        }
+
+        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceive(buffer, length, flag).Value();
+        }
+
+        int SendAll(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            const char* data = reinterpret_cast<const char*>(buffer);
+            int total = 0;
+            while (total < length)
+                total += Send(data + total, length - total, flag);
+            return total;
+        }
+
+        int ReceiveExact(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            char* data = reinterpret_cast<char*>(buffer);
+            int total = 0;
+            while (total < length) {
+                int received_length = Receive(data + total, length - total, flag);
+                if (received_length == 0)
+                    throw WSAEDISCON;
+                total += received_length;
+            }
+            return total;
+        }
+
+    };
+
+    template<int _AF>
+    class MemoryListenSocket {
+    private:
+        MemoryNetwork<_AF>* _network;
+        std::shared_ptr<typename MemoryNetwork<_AF>::Backlog> _backlog;
+        SocketAddr<_AF> _local;
+        bool _nonblocking;
+
+    public:
+
+        MemoryListenSocket(MemoryNetwork<_AF>& network = MemoryNetwork<_AF>::Default()) :
+            _network(&network), _local(), _nonblocking(false) { }
+
+        MemoryListenSocket(const MemoryListenSocket<_AF>&) = delete;
+
+        MemoryListenSocket<_AF>& operator=(const MemoryListenSocket<_AF>&) = delete;
+
+        ~MemoryListenSocket() {
+            Close();
+        }
+
+        // Close may be called from another thread to interrupt a blocked
+        // TryAccept, so it marks the backlog closed but leaves _backlog set.
+        void Close() {
+            if (!_backlog)
+                return;
+            std::deque<MemoryCommunicateSocket<_AF>> pending;
+            {
+                std::lock_guard<std::mutex> lock(_backlog->mutex);
+                if (_backlog->closed)
+                    return;
+                _backlog->closed = true;
+                pending.swap(_backlog->pending);
+            }
+            _network->UnbindListener(_local);
+            _backlog->ready.notify_all();
+        }
+
+        void SetNonBlocking(bool enable) {
+            _nonblocking = enable;
+        }
+
+        template<typename _Option>
+        void SetOption(const typename _Option::ValueType&) const { }
+
+        void SetReuseAddress(bool) const { }
+
+        SocketAddr<_AF> GetSocketName() const {
+            return _local;
+        }
+
+        void Bind(const SocketAddr<_AF>& address) throw(DWORD) {
+            if (_backlog)
+                throw WSAEINVAL;
+            std::shared_ptr<typename MemoryNetwork<_AF>::Backlog> backlog = std::make_shared<typename MemoryNetwork<_AF>::Backlog>();
+            backlog->limit = 0;
+            backlog->closed = false;
+            SocketAddr<_AF> local = address;
+            _network->BindListener(local, backlog);
+            _local = local;
+            _backlog = backlog;
+        }
+
+        void Bind(const TCHAR* LocalAddress, u_short LocalPort) throw(DWORD) {
+            Bind(SocketAddr<_AF>(LocalAddress, LocalPort));
+        }
+
+        void Listen(int backlog) const throw(DWORD) {
+            if (!_backlog)
+                throw WSAEINVAL;
+            std::lock_guard<std::mutex> lock(_backlog->mutex);
+            _backlog->limit = backlog > 0 ? backlog : 1;
+        }
+
+        Result<MemoryCommunicateSocket<_AF>> TryAccept() const {
+            std::shared_ptr<typename MemoryNetwork<_AF>::Backlog> backlog = _backlog;
+            if (!backlog)
+                return Result<MemoryCommunicateSocket<_AF>>::Error(WSAEINVAL);
+
+            std::unique_lock<std::mutex> lock(backlog->mutex);
+            if (backlog->pending.empty()) {
+                if (backlog->closed)
+                    return Result<MemoryCommunicateSocket<_AF>>::Error(WSAEINTR);
+                if (_nonblocking)
+                    return Result<MemoryCommunicateSocket<_AF>>::Error(WSAEWOULDBLOCK);
+                backlog->ready.wait(lock, [&backlog]() { return backlog->closed || !backlog->pending.empty(); });
+                if (backlog->pending.empty())
+                    return Result<MemoryCommunicateSocket<_AF>>::Error(WSAEINTR);
+            }
+
+            MemoryCommunicateSocket<_AF> accepted(std::move(backlog->pending.front()));
+            backlog->pending.pop_front();
+            accepted.SetNonBlocking(_nonblocking);
+            return std::move(accepted);
+        }
+
+        MemoryCommunicateSocket<_AF> Accept() const throw(DWORD) {
+            return std::move(TryAccept().Value());
+        }
+
+    };
+
+    //----------------------------
+    //  Datagram sockets
+    //----------------------------
+
+    template<int _AF>
+    class MemoryUDPSocket {
+    public:
+
+        typedef typename UDPSocket<_AF>::ReceiveInfo ReceiveInfo;
+
+    private:
+
+        struct Record {
+            ULONGLONG deliver_at;
+            ULONGLONG length;
+            SocketAddr<_AF> from;
+        };
+
+        MemoryNetwork<_AF>* _network;
+        mutable std::shared_ptr<MemoryDatagramQueue<_AF>> _queue;
+        mutable SocketAddr<_AF> _local;
+        mutable MemoryLink _link;
+        mutable std::string _last_key;
+        mutable std::weak_ptr<MemoryDatagramQueue<_AF>> _last_queue;
+        // Guards the sender-side state above; TrySendTo is const and may be
+        // called from several threads, as with a kernel UDP socket.
+        mutable std::mutex _sender;
+        bool _nonblocking;
+
+        void EnsureBound(const SocketAddr<_AF>& like) const throw(DWORD) {
+            if (_queue)
+                return;
+            SocketAddr<_AF> local = like;
+            SetAddressPort(local, 0);
+            std::shared_ptr<MemoryDatagramQueue<_AF>> queue = std::make_shared<MemoryDatagramQueue<_AF>>(_network->GetRingSize());
+            _network->BindDatagram(local, queue);
+            _local = local;
+            _queue = queue;
+        }
+
+        std::shared_ptr<MemoryDatagramQueue<_AF>> Lookup(const SocketAddr<_AF>& to) const {
+            std::string key = MemoryKey(to, false);
+            if (key == _last_key) {
+                std::shared_ptr<MemoryDatagramQueue<_AF>> queue = _last_queue.lock();
+                if (queue)
+                    return queue;
+            }
+            std::shared_ptr<MemoryDatagramQueue<_AF>> queue = _network->FindDatagram(to);
+            _last_key = key;
+            _last_queue = queue;
+            return queue;
+        }
+
+    public:
+
+        MemoryUDPSocket(MemoryNetwork<_AF>& network = MemoryNetwork<_AF>::Default()) :
+            _network(&network), _local(), _nonblocking(false) { }
+
+        MemoryUDPSocket(const MemoryUDPSocket<_AF>&) = delete;
+
+        MemoryUDPSocket<_AF>& operator=(const MemoryUDPSocket<_AF>&) = delete;
+
+        ~MemoryUDPSocket() {
+            Close();
+        }
+
+        void Close() {
+            std::lock_guard<std::mutex> lock(_sender);
+            if (!_queue)
+                return;
+            _network->UnbindDatagram(_local);
+            _queue->ring.CloseReader();
+            _queue.reset();
+        }
+
+        void SetNonBlocking(bool enable) {
+            _nonblocking = enable;
+        }
+
+        template<typename _Option>
+        void SetOption(const typename _Option::ValueType&) const { }
+
+        void SetLinkProfile(const LinkProfile& profile, ULONGLONG seed = 0x9E3779B97F4A7C15ULL) {
+            std::lock_guard<std::mutex> lock(_sender);
+            _link.SetProfile(profile, seed);
+        }
+
+        SocketAddr<_AF> GetSocketName() const {
+            std::lock_guard<std::mutex> lock(_sender);
+            return _local;
+        }
+
+        void Bind(const SocketAddr<_AF>& address) throw(DWORD) {
+            std::lock_guard<std::mutex> lock(_sender);
+            if (_queue)
+                throw WSAEINVAL;
+            SocketAddr<_AF> local = address;
+            std::shared_ptr<MemoryDatagramQueue<_AF>> queue = std::make_shared<MemoryDatagramQueue<_AF>>(_network->GetRingSize());
+            _network->BindDatagram(local, queue);
+            _local = local;
+            _queue = queue;
+        }
+
+        void Bind(const TCHAR* LocalAddress, u_short LocalPort) throw(DWORD) {
+            Bind(SocketAddr<_AF>(LocalAddress, LocalPort));
+        }
+
+        Result<int> TrySendTo(const void* buffer, int length, const SocketAddr<_AF>& to, int flag = 0) const {
+            std::lock_guard<std::mutex> lock(_sender);
+            try {
+                EnsureBound(to);
+            } catch (DWORD error) {
+                return Result<int>::Error(error);
+            }
+
+            if (_link.Lose())
+                return length;
+            std::shared_ptr<MemoryDatagramQueue<_AF>> queue = Lookup(to);
+            if (!queue || queue->ring.IsReaderClosed())
+                return length;
+            if (sizeof(Record) + static_cast<size_t>(length) > queue->ring.GetCapacity())
+                return Result<int>::Error(WSAEMSGSIZE);
+
+            // A full ring drops the datagram, as a full kernel receive buffer would.
+            Record record = { _link.Schedule(length), static_cast<ULONGLONG>(length), _local };
+            std::lock_guard<std::mutex> producers(queue->producers);
+            queue->ring.Push(&record, sizeof(record), buffer, static_cast<size_t>(length));
+            return length;
+        }
+
+        // Receives must stay on one thread at a time; the queue is single-consumer.
+        Result<ReceiveInfo> TryReceiveFrom(void* buffer, int length, int flag = 0) const {
+            std::shared_ptr<MemoryDatagramQueue<_AF>> queue;
+            {
+                std::lock_guard<std::mutex> lock(_sender);
+                queue = _queue;
+            }
+            if (!queue)
+                return Result<ReceiveInfo>::Error(WSAEINVAL);
+
+            MemoryRing& ring = queue->ring;
+            for (;;) {
+                ULONG sequence = ring.GetSequence();
+                DWORD timeout = INFINITE;
+                Record record;
+                if (ring.Peek(&record, sizeof(record))) {
+                    ULONGLONG now = MemoryClockNow();
+                    if (record.deliver_at <= now) {
+                        ring.Release(sizeof(record));
+                        size_t copied = record.length < static_cast<ULONGLONG>(length) ?
+                                        static_cast<size_t>(record.length) : static_cast<size_t>(length);
+                        ring.Read(buffer, copied);
+                        ring.Release(static_cast<size_t>(record.length));
+                        if (copied < record.length)
+                            return Result<ReceiveInfo>::Error(WSAEMSGSIZE);
+
+                        ReceiveInfo info = { };
+                        info.length = static_cast<int>(copied);
+                        info.from = record.from;
+                        info.timestamp = record.deliver_at;
+                        return info;
+                    }
+                    timeout = MemoryClockMilliseconds(record.deliver_at - now);
+                }
+                if (_nonblocking)
+                    return Result<ReceiveInfo>::Error(WSAEWOULDBLOCK);
+                ring.Wait(sequence, timeout);
+            }
+        }
+
+        int SendTo(const void* buffer, int length, const SocketAddr<_AF>& to, int flag = 0) const throw(DWORD) {
+            return TrySendTo(buffer, length, to, flag).Value();
+        }
+
+        ReceiveInfo ReceiveFrom(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceiveFrom(buffer, length, flag).Value();
+        }
+
+    };
+
+    //----------------------------
+    //  Transport traits
+    //----------------------------
+
+    template<int _AF>
+    struct KernelTransport {
+        typedef TCPListenSocket<_AF> ListenSocket;
+        typedef TCPCommunicateSocket<_AF> StreamSocket;
+        typedef UDPSocket<_AF> DatagramSocket;
+        typedef SocketAddr<_AF> Address;
+    };
+
+    template<int _AF>
+    struct MemoryTransport {
+        typedef MemoryListenSocket<_AF> ListenSocket;
+        typedef MemoryCommunicateSocket<_AF> StreamSocket;
+        typedef MemoryUDPSocket<_AF> DatagramSocket;
+        typedef SocketAddr<_AF> Address;
+    };
+
+}
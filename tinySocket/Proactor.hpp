@@ -0,0 +1,434 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include "UDPSocket.hpp"
+#include <MSWSock.h>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_set>
+
+#pragma comment(lib, "Mswsock.lib")
+
+namespace tinySocket {
+
+    class Proactor {
+    public:
+
+        typedef std::function<void(DWORD, DWORD)> Handler;
+
+    private:
+
+        struct Operation {
+            OVERLAPPED overlapped;
+            SOCKET descriptor;
+            WSABUF buffer;
+            DWORD flags;
+            DWORD error;
+            DWORD transferred;
+            INT address_length;
+            char address[2 * (sizeof(SOCKADDR_STORAGE) + 16)];
+            std::function<void(const Operation&)> complete;
+            Operation* next;
+            bool active;
+        };
+
+        HANDLE _port;
+        Operation* _free;
+        std::vector<Operation*> _operations;
+        size_t _active;
+        std::vector<OVERLAPPED_ENTRY> _entries;
+        std::vector<Operation*> _ready;
+        std::unordered_set<SOCKET> _skipping;
+        LPFN_ACCEPTEX _acceptex;
+        LPFN_CONNECTEX _connectex;
+        bool _stopped;
+
+        Operation* Acquire(SOCKET descriptor) {
+            Operation* op = _free;
+            if (op != nullptr) {
+                _free = op->next;
+            } else {
+                op = new Operation();
+                _operations.push_back(op);
+            }
+            ZeroMemory(&op->overlapped, sizeof(op->overlapped));
+            op->descriptor = descriptor;
+            op->flags = 0;
+            op->error = 0;
+            op->transferred = 0;
+            op->address_length = sizeof(op->address);
+            op->next = nullptr;
+            op->active = true;
+            ++_active;
+            return op;
+        }
+
+        void Release(Operation* op) {
+            op->active = false;
+            --_active;
+            op->complete = nullptr;
+            op->next = _free;
+            _free = op;
+        }
+
+        void Submit(Operation* op, int status, DWORD transferred) {
+            if (status == 0) {
+                if (_skipping.find(op->descriptor) != _skipping.end()) {
+                    op->transferred = transferred;
+                    _ready.push_back(op);
+                }
+                return;
+            }
+
+            DWORD error = WSAGetLastError();
+            if (error == WSA_IO_PENDING)
+                return;
+            op->error = error;
+            _ready.push_back(op);
+        }
+
+        void Complete(Operation* op) {
+            try {
+                op->complete(*op);
+            } catch (...) {
+                Release(op);
+                throw;
+            }
+            Release(op);
+        }
+
+        Operation* Dequeue(const OVERLAPPED_ENTRY& entry) {
+            if (entry.lpOverlapped == nullptr) {
+                _stopped = true;
+                return nullptr;
+            }
+
+            Operation* op = CONTAINING_RECORD(entry.lpOverlapped, Operation, overlapped);
+            op->transferred = entry.dwNumberOfBytesTransferred;
+            if (entry.Internal != 0) {
+                DWORD flags = 0;
+                if (!::WSAGetOverlappedResult(op->descriptor, &op->overlapped, &op->transferred, FALSE, &flags))
+                    op->error = WSAGetLastError();
+            }
+            return op;
+        }
+
+        template<typename _Fn>
+        static _Fn LoadExtension(SOCKET descriptor, GUID guid) throw(DWORD) {
+            _Fn function = nullptr;
+            DWORD bytes = 0;
+            if (::WSAIoctl(descriptor, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                           &guid, sizeof(guid), &function, sizeof(function),
+                           &bytes, nullptr, nullptr) != 0)
+                throw WSAGetLastError();
+            return function;
+        }
+
+    public:
+
+        static const DWORD CloseTimeout = 1000;
+
+        Proactor(ULONG batch = 128) throw(DWORD) :
+            _free(nullptr), _active(0), _entries(batch), _acceptex(nullptr), _connectex(nullptr), _stopped(false) {
+            _port = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+            if (_port == nullptr)
+                throw ::GetLastError();
+        }
+
+        Proactor(const Proactor&) = delete;
+
+        Proactor& operator=(const Proactor&) = delete;
+
+        // Outstanding I/O is cancelled and its completions drained without running
+        // handlers. An operation the kernel never gives back is leaked rather than
+        // freed, because the kernel may still write into it.
+        ~Proactor() {
+            for (Operation* op : _ready)
+                Release(op);
+            _ready.clear();
+
+            for (Operation* op : _operations) {
+                if (op->active)
+                    ::CancelIoEx(reinterpret_cast<HANDLE>(op->descriptor), &op->overlapped);
+            }
+            while (_active != 0) {
+                ULONG removed = 0;
+                if (!::GetQueuedCompletionStatusEx(_port, _entries.data(), static_cast<ULONG>(_entries.size()),
+                                                   &removed, CloseTimeout, FALSE))
+                    break;
+                for (ULONG i = 0; i < removed; ++i) {
+                    if (_entries[i].lpOverlapped == nullptr)
+                        continue;
+                    Operation* op = CONTAINING_RECORD(_entries[i].lpOverlapped, Operation, overlapped);
+                    if (op->active)
+                        Release(op);
+                }
+            }
+            ::CloseHandle(_port);
+
+            for (Operation* op : _operations) {
+                if (!op->active)
+                    delete op;
+            }
+        }
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Associate(const Socket<_AF, _SocketType, _Protocol>& socket) throw(DWORD) {
+            SOCKET descriptor = socket.GetDescriptor();
+            if (::CreateIoCompletionPort(reinterpret_cast<HANDLE>(descriptor), _port, 0, 0) == nullptr)
+                throw ::GetLastError();
+
+            WSAPROTOCOL_INFO info = { };
+            int info_size = sizeof(info);
+            if (::getsockopt(descriptor, SOL_SOCKET, SO_PROTOCOL_INFO,
+                             reinterpret_cast<char*>(&info), &info_size) != 0)
+                throw WSAGetLastError();
+
+            _skipping.erase(descriptor);
+            if ((info.dwServiceFlags1 & XP1_IFS_HANDLES) != 0 &&
+                ::SetFileCompletionNotificationModes(reinterpret_cast<HANDLE>(descriptor),
+                                                     FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE))
+                _skipping.insert(descriptor);
+        }
+
+        //----------------------------
+        //  AcceptEx
+        //----------------------------
+
+        template<int _AF>
+        void Accept(const TCPListenSocket<_AF>& listener,
+                    std::function<void(DWORD, TCPCommunicateSocket<_AF>)> handler) throw(DWORD) {
+            if (_acceptex == nullptr)
+                _acceptex = LoadExtension<LPFN_ACCEPTEX>(listener.GetDescriptor(), WSAID_ACCEPTEX);
+
+            auto accepted = std::make_shared<TCPCommunicateSocket<_AF>>();
+            SOCKET listen_descriptor = listener.GetDescriptor();
+            Operation* op = Acquire(listen_descriptor);
+            op->complete = [accepted, listen_descriptor, handler](const Operation& op) {
+                DWORD error = op.error;
+                if (error == 0) {
+                    SOCKET descriptor = accepted->GetDescriptor();
+                    if (::setsockopt(descriptor, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
+                                     reinterpret_cast<const char*>(&listen_descriptor), sizeof(listen_descriptor)) != 0)
+                        error = WSAGetLastError();
+                }
+                handler(error, std::move(*accepted));
+            };
+
+            DWORD address_length = sizeof(SocketAddr<_AF>) + 16;
+            DWORD received = 0;
+            BOOL status = _acceptex(listen_descriptor, accepted->GetDescriptor(),
+                                    op->address, 0, address_length, address_length,
+                                    &received, &op->overlapped);
+            Submit(op, status ? 0 : SOCKET_ERROR, received);
+        }
+
+        //----------------------------
+        //  ConnectEx
+        //----------------------------
+
+        template<int _AF>
+        void Connect(const TCPCommunicateSocket<_AF>& socket, const SocketAddr<_AF>& to, Handler handler) throw(DWORD) {
+            SOCKET descriptor = socket.GetDescriptor();
+            if (_connectex == nullptr)
+                _connectex = LoadExtension<LPFN_CONNECTEX>(descriptor, WSAID_CONNECTEX);
+
+            SocketAddr<_AF> local;
+            ZeroMemory(&local, sizeof(local));
+            reinterpret_cast<sockaddr*>(&local)->sa_family = _AF;
+            if (::bind(descriptor, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0 &&
+                WSAGetLastError() != WSAEINVAL)
+                throw WSAGetLastError();
+
+            Operation* op = Acquire(descriptor);
+            op->complete = [handler](const Operation& op) {
+                DWORD error = op.error;
+                if (error == 0 &&
+                    ::setsockopt(op.descriptor, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, nullptr, 0) != 0)
+                    error = WSAGetLastError();
+                handler(error, op.transferred);
+            };
+
+            BOOL status = _connectex(descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to),
+                                     nullptr, 0, nullptr, &op->overlapped);
+            Submit(op, status ? 0 : SOCKET_ERROR, 0);
+        }
+
+        //----------------------------
+        //  WSASend / WSARecv
+        //----------------------------
+
+        template<int _AF>
+        void Send(const TCPCommunicateSocket<_AF>& socket, const void* buffer, int length, Handler handler) throw(DWORD) {
+            Operation* op = Acquire(socket.GetDescriptor());
+            op->buffer.buf = const_cast<char*>(reinterpret_cast<const char*>(buffer));
+            op->buffer.len = length;
+            op->complete = [handler](const Operation& op) {
+                handler(op.error, op.transferred);
+            };
+
+            DWORD sent = 0;
+            int status = ::WSASend(op->descriptor, &op->buffer, 1, &sent, 0, &op->overlapped, nullptr);
+            Submit(op, status, sent);
+        }
+
+        template<int _AF>
+        void Receive(const TCPCommunicateSocket<_AF>& socket, void* buffer, int length, Handler handler) throw(DWORD) {
+            Operation* op = Acquire(socket.GetDescriptor());
+            op->buffer.buf = reinterpret_cast<char*>(buffer);
+            op->buffer.len = length;
+            op->complete = [handler](const Operation& op) {
+                handler(op.error, op.transferred);
+            };
+
+            DWORD received = 0;
+            int status = ::WSARecv(op->descriptor, &op->buffer, 1, &received, &op->flags, &op->overlapped, nullptr);
+            Submit(op, status, received);
+        }
+
+        //----------------------------
+        //  TransmitFile
+        //----------------------------
+
+        template<int _AF>
+        void SendFile(const TCPCommunicateSocket<_AF>& socket, HANDLE file, ULONGLONG offset, DWORD length,
+                      Handler handler, DWORD flag = 0) throw(DWORD) {
+            Operation* op = Acquire(socket.GetDescriptor());
+            op->overlapped.Offset = static_cast<DWORD>(offset);
+            op->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            op->complete = [handler](const Operation& op) {
+                handler(op.error, op.transferred);
+            };
+
+            BOOL status = ::TransmitFile(op->descriptor, file, length, 0, &op->overlapped, nullptr, flag);
+            DWORD sent = 0;
+            DWORD flags = 0;
+            if (status)
+                ::WSAGetOverlappedResult(op->descriptor, &op->overlapped, &sent, FALSE, &flags);
+            Submit(op, status ? 0 : SOCKET_ERROR, sent);
+        }
+
+        //----------------------------
+        //  WSASendTo / WSARecvFrom
+        //----------------------------
+
+        template<int _AF>
+        void SendTo(const UDPSocket<_AF>& socket, const void* buffer, int length,
+                    const SocketAddr<_AF>& to, Handler handler) throw(DWORD) {
+            Operation* op = Acquire(socket.GetDescriptor());
+            op->buffer.buf = const_cast<char*>(reinterpret_cast<const char*>(buffer));
+            op->buffer.len = length;
+            memcpy(op->address, &to, sizeof(to));
+            op->complete = [handler](const Operation& op) {
+                handler(op.error, op.transferred);
+            };
+
+            DWORD sent = 0;
+            int status = ::WSASendTo(op->descriptor, &op->buffer, 1, &sent, 0,
+                                     reinterpret_cast<const sockaddr*>(op->address), sizeof(to),
+                                     &op->overlapped, nullptr);
+            Submit(op, status, sent);
+        }
+
+        template<int _AF>
+        void ReceiveFrom(const UDPSocket<_AF>& socket, void* buffer, int length,
+                         std::function<void(DWORD, const typename UDPSocket<_AF>::ReceiveInfo&)> handler) throw(DWORD) {
+            Operation* op = Acquire(socket.GetDescriptor());
+            op->buffer.buf = reinterpret_cast<char*>(buffer);
+            op->buffer.len = length;
+            op->address_length = sizeof(SocketAddr<_AF>);
+            op->complete = [handler](const Operation& op) {
+                typename UDPSocket<_AF>::ReceiveInfo info = { };
+                info.length = static_cast<int>(op.transferred);
+                memcpy(&info.from, op.address, sizeof(info.from));
+                handler(op.error, info);
+            };
+
+            DWORD received = 0;
+            int status = ::WSARecvFrom(op->descriptor, &op->buffer, 1, &received, &op->flags,
+                                       reinterpret_cast<sockaddr*>(op->address), &op->address_length,
+                                       &op->overlapped, nullptr);
+            Submit(op, status, received);
+        }
+
+        //----------------------------
+        //  closesocket
+        //----------------------------
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Close(Socket<_AF, _SocketType, _Protocol>& socket, Handler handler) throw(DWORD) {
+            SOCKET descriptor = socket.GetDescriptor();
+            _skipping.erase(descriptor);
+            Operation* op = Acquire(descriptor);
+            op->complete = [handler](const Operation& op) {
+                handler(op.error, 0);
+            };
+
+            try {
+                socket.Close();
+            } catch (DWORD error) {
+                op->error = error;
+            }
+            _ready.push_back(op);
+        }
+
+        int RunOnce(DWORD timeout) throw(DWORD) {
+            int completed = 0;
+
+            size_t ready = _ready.size();
+            try {
+                while (static_cast<size_t>(completed) < ready) {
+                    Operation* op = _ready[completed++];
+                    Complete(op);
+                }
+            } catch (...) {
+                _ready.erase(_ready.begin(), _ready.begin() + completed);
+                throw;
+            }
+            _ready.erase(_ready.begin(), _ready.begin() + ready);
+            if (completed != 0 || !_ready.empty())
+                timeout = 0;
+
+            ULONG removed = 0;
+            if (!::GetQueuedCompletionStatusEx(_port, _entries.data(), static_cast<ULONG>(_entries.size()),
+                                               &removed, timeout, FALSE)) {
+                DWORD error = ::GetLastError();
+                if (error == WAIT_TIMEOUT)
+                    return completed;
+                throw error;
+            }
+
+            for (ULONG i = 0; i < removed; ++i) {
+                Operation* op = Dequeue(_entries[i]);
+                if (op == nullptr)
+                    continue;
+                try {
+                    Complete(op);
+                } catch (...) {
+                    // The rest of the batch is already off the port; keep it for the next RunOnce.
+                    for (ULONG j = i + 1; j < removed; ++j) {
+                        Operation* pending = Dequeue(_entries[j]);
+                        if (pending != nullptr)
+                            _ready.push_back(pending);
+                    }
+                    throw;
+                }
+                ++completed;
+            }
+            return completed;
+        }
+
+        void Run() throw(DWORD) {
+            _stopped = false;
+            while (!_stopped)
+                RunOnce(INFINITE);
+        }
+
+        void Stop() throw(DWORD) {
+            if (!::PostQueuedCompletionStatus(_port, 0, 0, nullptr))
+                throw ::GetLastError();
+        }
+
+    };
+
+}
@@ -0,0 +1,238 @@
+#pragma once
+#include "Socket.hpp"
+#include "TimerWheel.hpp"
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+namespace tinySocket {
+
+    enum ReactorEvent : SHORT {
+        ReactorRead = POLLRDNORM,
+        ReactorWrite = POLLWRNORM,
+        ReactorError = POLLERR,
+        ReactorHangup = POLLHUP,
+        ReactorInvalid = POLLNVAL
+    };
+
+    class Reactor {
+    public:
+
+        typedef std::function<void(SOCKET, SHORT)> Handler;
+
+    private:
+
+        struct Entry {
+            Handler handler;
+            bool removed;
+        };
+
+        std::vector<WSAPOLLFD> _pollfds;
+        std::deque<Entry> _entries;
+        std::unordered_map<SOCKET, size_t> _index;
+        std::vector<std::pair<ULONGLONG, std::function<void()>>> _deferred;
+        ULONGLONG _next_deferred;
+        TimerWheel* _timers;
+        bool _dispatching;
+        bool _dirty;
+        bool _stopped;
+
+        void Compact() {
+            size_t i = 0;
+            while (i < _pollfds.size()) {
+                if (!_entries[i].removed) {
+                    ++i;
+                    continue;
+                }
+
+                // Removed entries are dropped off the tail first so that only a
+                // live entry is ever moved down and written back to _index.
+                size_t last = _pollfds.size() - 1;
+                if (!_entries[last].removed) {
+                    _pollfds[i] = _pollfds[last];
+                    _entries[i] = std::move(_entries[last]);
+                    _index[_pollfds[i].fd] = i;
+                }
+                _pollfds.pop_back();
+                _entries.pop_back();
+            }
+            _dirty = false;
+        }
+
+        void RunDeferred() {
+            size_t count = _deferred.size();
+            size_t i = 0;
+            try {
+                while (i < count) {
+                    std::function<void()> handler = std::move(_deferred[i].second);
+                    ++i;
+                    if (handler)
+                        handler();
+                }
+            } catch (...) {
+                _deferred.erase(_deferred.begin(), _deferred.begin() + i);
+                throw;
+            }
+            _deferred.erase(_deferred.begin(), _deferred.begin() + count);
+        }
+
+    public:
+
+        Reactor() : _next_deferred(0), _timers(nullptr), _dispatching(false), _dirty(false), _stopped(false) { }
+
+        Reactor(const Reactor&) = delete;
+
+        Reactor& operator=(const Reactor&) = delete;
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Register(const Socket<_AF, _SocketType, _Protocol>& socket, SHORT events, Handler handler) throw(DWORD) {
+            socket.SetNonBlocking(true);
+            Register(socket.GetDescriptor(), events, std::move(handler));
+        }
+
+        void Register(SOCKET descriptor, SHORT events, Handler handler) throw(DWORD) {
+            if (descriptor == INVALID_SOCKET)
+                throw WSAENOTSOCK;
+            if (_index.find(descriptor) != _index.end())
+                throw WSAEINVAL;
+
+            WSAPOLLFD pollfd = { };
+            pollfd.fd = descriptor;
+            pollfd.events = events;
+            _index[descriptor] = _pollfds.size();
+            _pollfds.push_back(pollfd);
+            _entries.push_back(Entry { std::move(handler), false });
+        }
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Modify(const Socket<_AF, _SocketType, _Protocol>& socket, SHORT events) throw(DWORD) {
+            Modify(socket.GetDescriptor(), events);
+        }
+
+        void Modify(SOCKET descriptor, SHORT events) throw(DWORD) {
+            auto it = _index.find(descriptor);
+            if (it == _index.end())
+                throw WSAENOTSOCK;
+            _pollfds[it->second].events = events;
+        }
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Remove(const Socket<_AF, _SocketType, _Protocol>& socket) throw(DWORD) {
+            Remove(socket.GetDescriptor());
+        }
+
+        void Remove(SOCKET descriptor) throw(DWORD) {
+            auto it = _index.find(descriptor);
+            if (it == _index.end())
+                throw WSAENOTSOCK;
+
+            size_t i = it->second;
+            _index.erase(it);
+            _entries[i].removed = true;
+            _pollfds[i].events = 0;
+            _dirty = true;
+            if (!_dispatching)
+                Compact();
+        }
+
+        SHORT GetEvents(SOCKET descriptor) const throw(DWORD) {
+            auto it = _index.find(descriptor);
+            if (it == _index.end())
+                throw WSAENOTSOCK;
+            return _pollfds[it->second].events;
+        }
+
+        size_t GetCount() const {
+            return _index.size();
+        }
+
+        ULONGLONG Defer(std::function<void()> handler) {
+            _deferred.emplace_back(++_next_deferred, std::move(handler));
+            return _next_deferred;
+        }
+
+        // Ids are handed out consecutively and only a prefix is ever erased, so
+        // an entry is found by its offset from the front; cancelling leaves a
+        // tombstone that RunDeferred skips.
+        void CancelDeferred(ULONGLONG id) {
+            if (_deferred.empty() || id < _deferred.front().first)
+                return;
+            ULONGLONG offset = id - _deferred.front().first;
+            if (offset < _deferred.size())
+                _deferred[static_cast<size_t>(offset)].second = nullptr;
+        }
+
+        void SetTimerWheel(TimerWheel* timers) {
+            _timers = timers;
+        }
+
+        TimerWheel* GetTimerWheel() const {
+            return _timers;
+        }
+
+        int RunOnce(INT timeout) throw(DWORD) {
+            if (_timers != nullptr)
+                timeout = _timers->GetTimeout(timeout);
+            if (!_deferred.empty())
+                timeout = 0;
+
+            if (_pollfds.empty()) {
+                if (_timers != nullptr && _timers->GetCount() != 0) {
+                    ::Sleep(timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
+                    _timers->Advance();
+                }
+                RunDeferred();
+                return 0;
+            }
+
+            int ready = ::WSAPoll(_pollfds.data(), static_cast<ULONG>(_pollfds.size()), timeout);
+            if (ready == SOCKET_ERROR)
+                throw WSAGetLastError();
+
+            int dispatched = 0;
+            size_t count = _pollfds.size();
+            _dispatching = true;
+            try {
+                for (size_t i = 0; i < count && dispatched < ready; ++i) {
+                    SHORT revents = _pollfds[i].revents;
+                    if (revents == 0)
+                        continue;
+                    _pollfds[i].revents = 0;
+                    ++dispatched;
+                    if (!_entries[i].removed)
+                        _entries[i].handler(_pollfds[i].fd, revents);
+                }
+            } catch (...) {
+                _dispatching = false;
+                if (_dirty)
+                    Compact();
+                throw;
+            }
+            _dispatching = false;
+            if (_dirty)
+                Compact();
+            if (_timers != nullptr)
+                _timers->Advance();
+            RunDeferred();
+            return dispatched;
+        }
+
+        bool IsIdle() const {
+            return _pollfds.empty() && _deferred.empty() && (_timers == nullptr || _timers->GetCount() == 0);
+        }
+
+        // Returns once Stop is called or nothing is left to wait for.
+        void Run(INT timeout = -1) throw(DWORD) {
+            _stopped = false;
+            while (!_stopped && !IsIdle())
+                RunOnce(timeout);
+        }
+
+        void Stop() {
+            _stopped = true;
+        }
+
+    };
+
+}
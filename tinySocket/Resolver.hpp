@@ -0,0 +1,225 @@
+#pragma once
+#include "Socket.hpp"
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+namespace tinySocket {
+
+    inline void SetAddressPort(SocketAddr<AF_INET>& address, u_short Port) {
+        address.sin_port = htons(Port);
+    }
+
+    inline void SetAddressPort(SocketAddr<AF_INET6>& address, u_short Port) {
+        address.sin6_port = htons(Port);
+    }
+
+    template<int _AF>
+    class Resolver {
+    public:
+
+        typedef std::basic_string<TCHAR> HostName;
+        typedef std::vector<SocketAddr<_AF>> AddressList;
+        typedef std::function<DWORD(const TCHAR*, AddressList&)> Lookup;
+        typedef std::function<void(DWORD, const AddressList&)> Handler;
+
+    private:
+
+        struct Entry {
+            AddressList addresses;
+            std::chrono::steady_clock::time_point expiry;
+            bool fixed;
+        };
+
+        std::mutex _mutex;
+        std::unordered_map<HostName, Entry> _cache;
+        std::chrono::milliseconds _ttl;
+        Lookup _lookup;
+
+        size_t _worker_count;
+        std::vector<std::thread> _workers;
+        std::deque<std::function<void()>> _tasks;
+        std::condition_variable _condition;
+        bool _stopped;
+
+        bool FindCached(const HostName& name, AddressList& addresses) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _cache.find(name);
+            if (it == _cache.end())
+                return false;
+            if (!it->second.fixed && it->second.expiry <= std::chrono::steady_clock::now()) {
+                _cache.erase(it);
+                return false;
+            }
+            addresses = it->second.addresses;
+            return true;
+        }
+
+        DWORD LookupAndCache(const HostName& name, AddressList& addresses) {
+            DWORD status = _lookup(name.c_str(), addresses);
+            if (status != 0)
+                return status;
+            if (addresses.empty())
+                return WSAHOST_NOT_FOUND;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            Entry& entry = _cache[name];
+            if (!entry.fixed) {
+                entry.addresses = addresses;
+                entry.expiry = std::chrono::steady_clock::now() + _ttl;
+            }
+            return 0;
+        }
+
+        static void ApplyPort(AddressList& addresses, u_short Port) {
+            for (SocketAddr<_AF>& address : addresses)
+                SetAddressPort(address, Port);
+        }
+
+        void Work() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this]() { return _stopped || !_tasks.empty(); });
+                    if (_tasks.empty())
+                        return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+
+        static DWORD SystemLookup(const TCHAR* Name, AddressList& addresses) {
+            ADDRINFOT hints = { };
+            hints.ai_family = _AF;
+            // Without a socktype getaddrinfo returns every address once per
+            // socktype/protocol; the address itself is the same for TCP and UDP.
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_protocol = IPPROTO_TCP;
+
+            ADDRINFOT* result = nullptr;
+            int status = GetAddrInfo(Name, nullptr, &hints, &result);
+            if (status != 0)
+                return status;
+
+            for (ADDRINFOT* it = result; it != nullptr; it = it->ai_next) {
+                if (it->ai_family != _AF || it->ai_addrlen < sizeof(SocketAddr<_AF>))
+                    continue;
+                SocketAddr<_AF> address;
+                memcpy(&address, it->ai_addr, sizeof(address));
+                addresses.push_back(address);
+            }
+            FreeAddrInfo(result);
+            return 0;
+        }
+
+        static Resolver<_AF>& Default() {
+            static Resolver<_AF> resolver;
+            return resolver;
+        }
+
+        Resolver(std::chrono::milliseconds ttl = std::chrono::seconds(60),
+                 size_t workers = 1,
+                 Lookup lookup = SystemLookup) :
+            _ttl(ttl), _lookup(lookup), _worker_count(workers), _stopped(false) { }
+
+        Resolver(const Resolver<_AF>&) = delete;
+
+        Resolver<_AF>& operator=(const Resolver<_AF>&) = delete;
+
+        ~Resolver() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopped = true;
+            }
+            _condition.notify_all();
+            for (std::thread& worker : _workers)
+                worker.join();
+        }
+
+        void AddHost(const TCHAR* Name, const SocketAddr<_AF>& address) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Entry& entry = _cache[Name];
+            if (!entry.fixed)
+                entry.addresses.clear();
+            entry.fixed = true;
+            entry.addresses.push_back(address);
+        }
+
+        void Invalidate(const TCHAR* Name) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _cache.find(Name);
+            if (it != _cache.end() && !it->second.fixed)
+                _cache.erase(it);
+        }
+
+        bool TryResolveCached(const TCHAR* Name, u_short Port, AddressList& addresses) {
+            if (!FindCached(Name, addresses))
+                return false;
+            ApplyPort(addresses, Port);
+            return true;
+        }
+
+        AddressList Resolve(const TCHAR* Name, u_short Port) throw(DWORD) {
+            AddressList addresses;
+            HostName name(Name);
+            if (!FindCached(name, addresses)) {
+                DWORD status = LookupAndCache(name, addresses);
+                if (status != 0)
+                    throw status;
+            }
+            ApplyPort(addresses, Port);
+            return addresses;
+        }
+
+        SocketAddr<_AF> ResolveOne(const TCHAR* Name, u_short Port) throw(DWORD) {
+            HostName name(Name);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _cache.find(name);
+                if (it != _cache.end() &&
+                    (it->second.fixed || it->second.expiry > std::chrono::steady_clock::now())) {
+                    SocketAddr<_AF> address = it->second.addresses.front();
+                    SetAddressPort(address, Port);
+                    return address;
+                }
+            }
+            return Resolve(Name, Port).front();
+        }
+
+        void ResolveAsync(const TCHAR* Name, u_short Port, Handler handler) {
+            AddressList addresses;
+            HostName name(Name);
+            if (FindCached(name, addresses)) {
+                ApplyPort(addresses, Port);
+                handler(0, addresses);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                while (_workers.size() < _worker_count)
+                    _workers.emplace_back([this]() { Work(); });
+                _tasks.push_back([this, name, Port, handler]() {
+                    AddressList addresses;
+                    DWORD status = LookupAndCache(name, addresses);
+                    ApplyPort(addresses, Port);
+                    handler(status, addresses);
+                });
+            }
+            _condition.notify_one();
+        }
+
+    };
+
+}
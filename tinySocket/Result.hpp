@@ -0,0 +1,71 @@
+#pragma once
+#include <WinSock2.h>
+#include <new>
+#include <utility>
+
+namespace tinySocket {
+
+    template<typename _Ty>
+    class Result {
+    private:
+        union {
+            _Ty _value;
+        };
+        DWORD _error;
+
+        Result(DWORD error, bool) : _error(error) { }
+
+    public:
+
+        static Result<_Ty> Error(DWORD error) {
+            return Result<_Ty>(error, false);
+        }
+
+        Result(const _Ty& value) : _value(value), _error(0) { }
+
+        Result(_Ty&& value) : _value(std::move(value)), _error(0) { }
+
+        Result(const Result<_Ty>& other) : _error(other._error) {
+            if (_error == 0)
+                new (&_value) _Ty(other._value);
+        }
+
+        Result(Result<_Ty>&& other) : _error(other._error) {
+            if (_error == 0)
+                new (&_value) _Ty(std::move(other._value));
+        }
+
+        Result<_Ty>& operator=(const Result<_Ty>&) = delete;
+
+        ~Result() {
+            if (_error == 0)
+                _value.~_Ty();
+        }
+
+        explicit operator bool() const {
+            return _error == 0;
+        }
+
+        DWORD GetError() const {
+            return _error;
+        }
+
+        bool WouldBlock() const {
+            return _error == WSAEWOULDBLOCK;
+        }
+
+        _Ty& Value() throw(DWORD) {
+            if (_error != 0)
+                throw _error;
+            return _value;
+        }
+
+        const _Ty& Value() const throw(DWORD) {
+            if (_error != 0)
+                throw _error;
+            return _value;
+        }
+
+    };
+
+}
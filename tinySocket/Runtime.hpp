@@ -0,0 +1,487 @@
+#pragma once
+#include "Reactor.hpp"
+#include "Buffer.hpp"
+#include "ListenerGroup.hpp"
+#include <new>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <exception>
+
+namespace tinySocket {
+
+    template<typename _Ty>
+    class MpscQueue {
+    private:
+
+        struct Node {
+            std::atomic<Node*> next;
+            std::optional<_Ty> value;
+        };
+
+        alignas(64) std::atomic<Node*> _head;
+        alignas(64) Node* _tail;
+
+        static Node* Allocate() {
+            return new (BufferPool::Allocate(sizeof(Node))) Node();
+        }
+
+        static void Free(Node* node) {
+            node->~Node();
+            BufferPool::Free(node, sizeof(Node));
+        }
+
+    public:
+
+        MpscQueue() {
+            Node* stub = Allocate();
+            _head.store(stub, std::memory_order_relaxed);
+            _tail = stub;
+        }
+
+        MpscQueue(const MpscQueue<_Ty>&) = delete;
+
+        MpscQueue<_Ty>& operator=(const MpscQueue<_Ty>&) = delete;
+
+        ~MpscQueue() {
+            while (TryPop())
+                ;
+            Free(_tail);
+        }
+
+        void Push(_Ty&& value) {
+            Node* node = Allocate();
+            node->value.emplace(std::move(value));
+            Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        std::optional<_Ty> TryPop() {
+            Node* tail = _tail;
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+                return std::nullopt;
+            std::optional<_Ty> value(std::move(next->value));
+            next->value.reset();
+            _tail = next;
+            Free(tail);
+            return value;
+        }
+
+    };
+
+    class WorkStealingDeque {
+    public:
+
+        typedef std::function<void()> Job;
+
+        static const LONGLONG Capacity = 4096;
+
+    private:
+        alignas(64) std::atomic<LONGLONG> _top;
+        alignas(64) std::atomic<LONGLONG> _bottom;
+        std::atomic<Job*> _jobs[Capacity];
+
+    public:
+
+        WorkStealingDeque() : _top(0), _bottom(0) {
+            for (LONGLONG i = 0; i < Capacity; ++i)
+                _jobs[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        ~WorkStealingDeque() {
+            while (Job* job = Pop())
+                delete job;
+        }
+
+        bool Push(Job* job) {
+            LONGLONG bottom = _bottom.load(std::memory_order_relaxed);
+            LONGLONG top = _top.load(std::memory_order_acquire);
+            if (bottom - top >= Capacity)
+                return false;
+            _jobs[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        Job* Pop() {
+            LONGLONG bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            LONGLONG top = _top.load(std::memory_order_relaxed);
+            if (top > bottom) {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* job = _jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (top == bottom) {
+                if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    job = nullptr;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* Steal() {
+            LONGLONG top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            LONGLONG bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+                return nullptr;
+
+            Job* job = _jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return job;
+        }
+
+        bool IsEmpty() const {
+            return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+        }
+
+    };
+
+    template<int _AF>
+    class Runtime {
+    public:
+
+        class Worker;
+
+        typedef std::function<void(Worker&, TCPCommunicateSocket<_AF>)> Handler;
+
+        typedef std::function<void(Worker&, const TCPCommunicateSocket<_AF>&, SHORT)> SocketHandler;
+
+        class Worker {
+            friend class Runtime<_AF>;
+        private:
+            Runtime<_AF>& _runtime;
+            size_t _index;
+            Reactor _reactor;
+            UDPSocket<AF_INET> _wakeup;
+            SocketAddr<AF_INET> _wakeup_address;
+            alignas(64) std::atomic<bool> _signaled;
+            std::atomic<bool> _parked;
+            MpscQueue<TCPCommunicateSocket<_AF>> _inbox;
+            MpscQueue<WorkStealingDeque::Job> _submitted;
+            WorkStealingDeque _jobs;
+            std::unordered_map<SOCKET, TCPCommunicateSocket<_AF>> _sockets;
+            std::thread _thread;
+
+            void Notify() {
+                if (_signaled.exchange(true, std::memory_order_acq_rel))
+                    return;
+                char signal = 0;
+                _wakeup.TrySendTo(&signal, 1, _wakeup_address);
+            }
+
+            // Runs user code; anything it throws goes to the error handler so the
+            // caller can carry on with the rest of its batch.
+            template<typename _Function>
+            void Contain(_Function&& function) {
+                try {
+                    function();
+                } catch (DWORD error) {
+                    ReportWorkerError(_runtime._error_handler, _index, error);
+                } catch (...) {
+                    ReportWorkerError(_runtime._error_handler, _index, ERROR_UNHANDLED_EXCEPTION);
+                }
+            }
+
+            void OnWakeup() {
+                char signal[16];
+                while (_wakeup.TryReceive(signal, sizeof(signal)))
+                    ;
+                _signaled.store(false, std::memory_order_release);
+
+                while (std::optional<WorkStealingDeque::Job> job = _submitted.TryPop())
+                    Contain([&]() { Enqueue(std::move(*job)); });
+                while (std::optional<TCPCommunicateSocket<_AF>> socket = _inbox.TryPop())
+                    Contain([&]() { _runtime._handler(*this, std::move(*socket)); });
+            }
+
+            // Chase-Lev pushes are owner-thread only; other threads go through _submitted.
+            void Enqueue(WorkStealingDeque::Job job) {
+                WorkStealingDeque::Job* owned = new WorkStealingDeque::Job(std::move(job));
+                if (!_jobs.Push(owned)) {
+                    RunJob(owned);
+                    return;
+                }
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                _runtime.WakeIdle(_index);
+            }
+
+            bool RunJob(WorkStealingDeque::Job* job) {
+                if (job == nullptr)
+                    return false;
+                std::unique_ptr<WorkStealingDeque::Job> owned(job);
+                Contain([&]() { (*owned)(); });
+                return true;
+            }
+
+            bool RunJobs() {
+                bool ran = false;
+                while (RunJob(_jobs.Pop()))
+                    ran = true;
+                return RunJob(_runtime.Steal(_index)) || ran;
+            }
+
+            // Handlers and jobs are contained individually, so anything reaching
+            // the catch here is a reactor failure; it stops the whole runtime and
+            // is rethrown from Stop.
+            void Run(bool pin) {
+                if (pin)
+                    TryPinCurrentThread(_runtime._error_handler, _index);
+
+                try {
+                    while (!_runtime._stopped.load(std::memory_order_acquire)) {
+                        bool busy = RunJobs();
+                        if (!busy) {
+                            _parked.store(true, std::memory_order_seq_cst);
+                            busy = RunJob(_runtime.Steal(_index));
+                        }
+                        _reactor.RunOnce(busy ? 0 : -1);
+                        _parked.store(false, std::memory_order_relaxed);
+                    }
+                } catch (...) {
+                    _parked.store(false, std::memory_order_relaxed);
+                    _runtime.Fail(std::current_exception());
+                }
+            }
+
+        public:
+
+            Worker(Runtime<_AF>& runtime, size_t index) throw(DWORD) :
+                _runtime(runtime), _index(index), _signaled(false), _parked(false) {
+                _wakeup.Bind(TEXT("127.0.0.1"), 0);
+                _wakeup_address = _wakeup.GetSocketName();
+                _reactor.Register(_wakeup, ReactorRead, [this](SOCKET, SHORT) { OnWakeup(); });
+            }
+
+            Worker(const Worker&) = delete;
+
+            Worker& operator=(const Worker&) = delete;
+
+            ~Worker() {
+                while (WorkStealingDeque::Job* job = _jobs.Pop())
+                    delete job;
+            }
+
+            size_t GetIndex() const {
+                return _index;
+            }
+
+            Reactor& GetReactor() {
+                return _reactor;
+            }
+
+            size_t GetSocketCount() const {
+                return _sockets.size();
+            }
+
+            void Adopt(TCPCommunicateSocket<_AF> socket, SHORT events, SocketHandler handler) throw(DWORD) {
+                SOCKET descriptor = socket.GetDescriptor();
+                auto it = _sockets.emplace(descriptor, std::move(socket)).first;
+                const TCPCommunicateSocket<_AF>& owned = it->second;
+                try {
+                    _reactor.Register(owned, events, [this, &owned, handler](SOCKET, SHORT revents) {
+                        Contain([&]() { handler(*this, owned, revents); });
+                    });
+                } catch (DWORD) {
+                    _sockets.erase(it);
+                    throw;
+                }
+            }
+
+            void Drop(SOCKET descriptor) throw(DWORD) {
+                _reactor.Remove(descriptor);
+                _sockets.erase(descriptor);
+            }
+
+            bool IsCurrentThread() const {
+                return std::this_thread::get_id() == _thread.get_id();
+            }
+
+            // Safe from any thread once the runtime has started; only the
+            // worker's own thread pushes onto its deque directly.
+            void Spawn(WorkStealingDeque::Job job) {
+                if (IsCurrentThread()) {
+                    Enqueue(std::move(job));
+                    return;
+                }
+                _submitted.Push(std::move(job));
+                Notify();
+            }
+
+            void Handoff(size_t target, TCPCommunicateSocket<_AF> socket) {
+                _runtime.Handoff(target, std::move(socket));
+            }
+
+        };
+
+    private:
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::unique_ptr<TCPListenSocket<_AF>> _listener;
+        Handler _handler;
+        WorkerErrorHandler _error_handler;
+        std::atomic<bool> _stopped;
+        size_t _next;
+        std::mutex _failure_mutex;
+        std::exception_ptr _failure;
+
+        bool IsStarted() const {
+            return _workers[0]->_thread.joinable();
+        }
+
+        void Signal() {
+            _stopped.store(true, std::memory_order_release);
+            for (std::unique_ptr<Worker>& worker : _workers)
+                worker->Notify();
+        }
+
+        void Fail(std::exception_ptr failure) {
+            {
+                std::lock_guard<std::mutex> lock(_failure_mutex);
+                if (!_failure)
+                    _failure = failure;
+            }
+            Signal();
+        }
+
+        WorkStealingDeque::Job* Steal(size_t thief) {
+            size_t count = _workers.size();
+            for (size_t i = 1; i < count; ++i) {
+                WorkStealingDeque::Job* job = _workers[(thief + i) % count]->_jobs.Steal();
+                if (job != nullptr)
+                    return job;
+            }
+            return nullptr;
+        }
+
+        void WakeIdle(size_t owner) {
+            size_t count = _workers.size();
+            for (size_t i = 1; i < count; ++i) {
+                Worker& worker = *_workers[(owner + i) % count];
+                if (worker._parked.load(std::memory_order_seq_cst)) {
+                    worker.Notify();
+                    return;
+                }
+            }
+        }
+
+        void OnAccept(Worker& worker) {
+            std::vector<typename TCPListenSocket<_AF>::AcceptInfo> accepted;
+            try {
+                _listener->AcceptMany(accepted, 64);
+            } catch (DWORD error) {
+                ReportWorkerError(_error_handler, worker._index, error);
+                if (accepted.empty())
+                    return;
+            }
+            for (typename TCPListenSocket<_AF>::AcceptInfo& info : accepted) {
+                size_t target = _next++ % _workers.size();
+                if (target == worker._index)
+                    worker.Contain([&]() { _handler(worker, std::move(info.socket)); });
+                else
+                    Handoff(target, std::move(info.socket));
+            }
+        }
+
+    public:
+
+        Runtime(size_t workers) throw(DWORD) : _stopped(true), _next(0) {
+            if (workers == 0)
+                workers = 1;
+            for (size_t i = 0; i < workers; ++i)
+                _workers.emplace_back(new Worker(*this, i));
+        }
+
+        Runtime(const Runtime<_AF>&) = delete;
+
+        Runtime<_AF>& operator=(const Runtime<_AF>&) = delete;
+
+        ~Runtime() {
+            try {
+                Stop();
+            } catch (...) {
+            }
+        }
+
+        size_t GetWorkerCount() const {
+            return _workers.size();
+        }
+
+        Worker& GetWorker(size_t index) {
+            return *_workers[index];
+        }
+
+        // Handler, job and accept errors are passed here with the worker index;
+        // DWORDs are reported as-is, anything else as ERROR_UNHANDLED_EXCEPTION.
+        void SetErrorHandler(WorkerErrorHandler handler) throw(DWORD) {
+            if (IsStarted())
+                throw WSAEINVAL;
+            _error_handler = std::move(handler);
+        }
+
+        // The listener is registered with worker 0's reactor, so Listen must be
+        // called before Start.
+        const TCPListenSocket<_AF>& Listen(const TCHAR* LocalAddress, u_short LocalPort, int backlog) throw(DWORD) {
+            if (IsStarted())
+                throw WSAEINVAL;
+            _listener.reset(new TCPListenSocket<_AF>());
+            _listener->SetReuseAddress(true);
+            _listener->Bind(LocalAddress, LocalPort);
+            _listener->Listen(backlog);
+            Worker& acceptor = *_workers[0];
+            acceptor._reactor.Register(*_listener, ReactorRead, [this, &acceptor](SOCKET, SHORT) { OnAccept(acceptor); });
+            return *_listener;
+        }
+
+        void Handoff(size_t target, TCPCommunicateSocket<_AF> socket) {
+            Worker& worker = *_workers[target % _workers.size()];
+            worker._inbox.Push(std::move(socket));
+            worker.Notify();
+        }
+
+        // Fails with WSAEINVAL while a previous Start has not been stopped.
+        void Start(Handler handler, bool pin = true) throw(DWORD) {
+            if (IsStarted())
+                throw WSAEINVAL;
+            _handler = std::move(handler);
+            _stopped = false;
+            for (std::unique_ptr<Worker>& worker : _workers) {
+                Worker* w = worker.get();
+                w->_thread = std::thread([w, pin]() { w->Run(pin); });
+            }
+        }
+
+        bool IsStopped() const {
+            return _stopped.load(std::memory_order_acquire);
+        }
+
+        // Joins the workers, then rethrows the first reactor failure if one
+        // stopped the runtime. Call it from the thread that called Start.
+        void Stop() {
+            Signal();
+            for (std::unique_ptr<Worker>& worker : _workers) {
+                if (worker->_thread.joinable())
+                    worker->_thread.join();
+            }
+
+            std::exception_ptr failure;
+            {
+                std::lock_guard<std::mutex> lock(_failure_mutex);
+                std::swap(failure, _failure);
+            }
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+
+    };
+
+}
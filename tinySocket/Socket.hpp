@@ -1,6 +1,9 @@
 #pragma once
 #include <WinSock2.h>
 #include <WS2tcpip.h>
+#include "Result.hpp"
+#include "SocketOption.hpp"
+#include "Instrumentation.hpp"
 
 #pragma comment(lib, "WS2_32.lib")
 
@@ -64,12 +67,13 @@ namespace tinySocket {
         Socket(const Socket<_AF, _SocketType, _Protocol>&) = delete;
 
         Socket(Socket<_AF, _SocketType, _Protocol>&& other) : _descriptor(other._descriptor) {
-            other._descriptor = INVALID_SOCKET;sockaddr
+            other._descriptor = INVALID_SOCKET;
         }
 
         ~Socket() throw(DWORD) {
             if (_descriptor == INVALID_SOCKET)
                 return;
+            Instrumentation::Forget(_descriptor);
             if (closesocket(_descriptor) != 0)
                 throw WSAGetLastError();
         }
@@ -131,6 +135,16 @@ namespace tinySocket {
             return Status == 0 ? false : true;
         }
 
+        //----------------------------
+        //  FIONBIO
+        //----------------------------
+
+        void SetNonBlocking(bool enable) const throw(DWORD) {
+            u_long Mode = enable ? 1 : 0;
+            if (::ioctlsocket(_descriptor, FIONBIO, &Mode) != 0)
+                throw WSAGetLastError();
+        }
+
         void GetSocketOption(int Level, int OptionName, 
                              void* OptionValue, int OptionLength) const throw(DWORD) {
             if (::getsockopt(_descriptor,
@@ -147,10 +161,29 @@ namespace tinySocket {
                 throw WSAGetLastError();
         }
 
+        template<typename _Option>
+        void SetOption(const typename _Option::ValueType& value) const throw(DWORD) {
+            if (::setsockopt(_descriptor,
+                             _Option::Level, _Option::Name,
+                             reinterpret_cast<const char*>(&value), sizeof(value)) != 0)
+                throw WSAGetLastError();
+        }
+
+        template<typename _Option>
+        typename _Option::ValueType GetOption() const throw(DWORD) {
+            typename _Option::ValueType value = { };
+            int value_size = sizeof(value);
+            if (::getsockopt(_descriptor,
+                             _Option::Level, _Option::Name,
+                             reinterpret_cast<char*>(&value), &value_size) != 0)
+                throw WSAGetLastError();
+            return value;
+        }
+
         SocketAddr<_AF> GetSocketName() const throw(DWORD) {
             SocketAddr<_AF> ret = { };
             int ret_size = sizeof(ret);
-            if (::getsockname(_descriptor, reinterpret_cast<sockaddr*>(&ret), sizeof(ret)) != 0)
+            if (::getsockname(_descriptor, reinterpret_cast<sockaddr*>(&ret), &ret_size) != 0)
                 throw WSAGetLastError();
 
             return ret;
@@ -159,13 +192,14 @@ namespace tinySocket {
         SocketAddr<_AF> GetPeerName() const throw(DWORD) {
             SocketAddr<_AF> ret = { };
             int ret_size = sizeof(ret);
-            if (::getpeername(_descriptor, reinterpret_cast<sockaddr*>(&ret), sizeof(ret)) != 0)
+            if (::getpeername(_descriptor, reinterpret_cast<sockaddr*>(&ret), &ret_size) != 0)
                 throw WSAGetLastError();
 
             return ret;
         }
 
         void Close() {
+            Instrumentation::Forget(_descriptor);
             if (closesocket(_descriptor) != 0)
                 throw WSAGetLastError();
             _descriptor = INVALID_SOCKET;
@@ -0,0 +1,73 @@
+#pragma once
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <MSTcpIP.h>
+
+namespace tinySocket {
+
+    template<int _Level, int _Name, typename _Ty>
+    struct SocketOption {
+        typedef _Ty ValueType;
+        enum : int {
+            Level = _Level,
+            Name = _Name
+        };
+    };
+
+    namespace Option {
+
+        //----------------------------
+        //  SOL_SOCKET
+        //----------------------------
+
+        typedef SocketOption<SOL_SOCKET, SO_ACCEPTCONN, DWORD> AcceptConnection;
+        typedef SocketOption<SOL_SOCKET, SO_BROADCAST, DWORD> Broadcast;
+        typedef SocketOption<SOL_SOCKET, SO_CONDITIONAL_ACCEPT, DWORD> ConditionalAccept;
+        typedef SocketOption<SOL_SOCKET, SO_DEBUG, DWORD> Debug;
+        typedef SocketOption<SOL_SOCKET, SO_DONTLINGER, DWORD> DontLinger;
+        typedef SocketOption<SOL_SOCKET, SO_DONTROUTE, DWORD> DontRoute;
+        typedef SocketOption<SOL_SOCKET, SO_ERROR, DWORD> Error;
+        typedef SocketOption<SOL_SOCKET, SO_EXCLUSIVEADDRUSE, DWORD> ExclusiveAddressUse;
+        typedef SocketOption<SOL_SOCKET, SO_KEEPALIVE, DWORD> KeepAlive;
+        typedef SocketOption<SOL_SOCKET, SO_LINGER, linger> Linger;
+        typedef SocketOption<SOL_SOCKET, SO_MAX_MSG_SIZE, DWORD> MaxMessageSize;
+        typedef SocketOption<SOL_SOCKET, SO_OOBINLINE, DWORD> OutOfBandInline;
+        typedef SocketOption<SOL_SOCKET, SO_PORT_SCALABILITY, DWORD> PortScalability;
+        typedef SocketOption<SOL_SOCKET, SO_RCVBUF, int> ReceiveBuffer;
+        typedef SocketOption<SOL_SOCKET, SO_RCVTIMEO, DWORD> ReceiveTimeout;
+        typedef SocketOption<SOL_SOCKET, SO_REUSEADDR, DWORD> ReuseAddress;
+        typedef SocketOption<SOL_SOCKET, SO_REUSE_UNICASTPORT, DWORD> ReuseUnicastPort;
+        typedef SocketOption<SOL_SOCKET, SO_SNDBUF, int> SendBuffer;
+        typedef SocketOption<SOL_SOCKET, SO_SNDTIMEO, DWORD> SendTimeout;
+        typedef SocketOption<SOL_SOCKET, SO_TYPE, DWORD> Type;
+
+        //----------------------------
+        //  IPPROTO_TCP
+        //----------------------------
+
+        typedef SocketOption<IPPROTO_TCP, TCP_NODELAY, DWORD> NoDelay;
+        typedef SocketOption<IPPROTO_TCP, TCP_FASTOPEN, DWORD> FastOpen;
+        typedef SocketOption<IPPROTO_TCP, TCP_KEEPALIVE, DWORD> KeepAliveTime;
+        typedef SocketOption<IPPROTO_TCP, TCP_KEEPINTVL, DWORD> KeepAliveInterval;
+        typedef SocketOption<IPPROTO_TCP, TCP_KEEPCNT, DWORD> KeepAliveCount;
+        typedef SocketOption<IPPROTO_TCP, TCP_MAXRT, DWORD> MaxRetransmitTime;
+
+        //----------------------------
+        //  IPPROTO_UDP
+        //----------------------------
+
+        typedef SocketOption<IPPROTO_UDP, UDP_SEND_MSG_SIZE, DWORD> SendMessageSize;
+        typedef SocketOption<IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE, DWORD> ReceiveMaxCoalescedSize;
+
+        //----------------------------
+        //  IPPROTO_IP / IPPROTO_IPV6
+        //----------------------------
+
+        typedef SocketOption<IPPROTO_IP, IP_TTL, DWORD> TimeToLive;
+        typedef SocketOption<IPPROTO_IP, IP_TOS, DWORD> TypeOfService;
+        typedef SocketOption<IPPROTO_IPV6, IPV6_UNICAST_HOPS, DWORD> UnicastHops;
+        typedef SocketOption<IPPROTO_IPV6, IPV6_V6ONLY, DWORD> V6Only;
+
+    }
+
+}
@@ -1,5 +1,10 @@
 #pragma once
 #include "Socket.hpp"
+#include "Resolver.hpp"
+#include <MSWSock.h>
+#include <vector>
+
+#pragma comment(lib, "Mswsock.lib")
 
 namespace tinySocket {
 
@@ -104,6 +109,42 @@ namespace tinySocket {
             return _linger;
         }
 
+        //----------------------------
+        //  SIO_TCP_INFO
+        //----------------------------
+
+        TCP_INFO_v0 GetTcpInfo() const throw(DWORD) {
+            DWORD version = 0;
+            TCP_INFO_v0 info = { };
+            DWORD bytes = 0;
+            if (::WSAIoctl(_descriptor, SIO_TCP_INFO, &version, sizeof(version),
+                           &info, sizeof(info), &bytes, nullptr, nullptr) != 0)
+                throw WSAGetLastError();
+            return info;
+        }
+
+        //----------------------------
+        //  TCP_FASTOPEN
+        //----------------------------
+
+        void SetFastOpen(bool enable) const throw(DWORD) {
+            DWORD Status = enable ? TRUE : FALSE;
+            if (::setsockopt(_descriptor,
+                             IPPROTO_TCP, TCP_FASTOPEN,
+                             reinterpret_cast<char*>(&Status), sizeof(Status)) != 0)
+                throw WSAGetLastError();
+        }
+
+        bool GetFastOpenStatus() const throw(DWORD) {
+            DWORD Status;
+            int StatusLength = sizeof(Status);
+            if (::getsockopt(_descriptor,
+                             IPPROTO_TCP, TCP_FASTOPEN,
+                             reinterpret_cast<char*>(&Status), &StatusLength) != 0)
+                throw WSAGetLastError();
+            return Status == 0 ? false : true;
+        }
+
     };
 
     template<int _AF>
@@ -112,9 +153,31 @@ namespace tinySocket {
     template<int _AF>
     class TCPListenSocket;
 
+    class UnixCommunicateSocket;
+
     template<int _AF>
     class TCPCommunicateSocket : public TCPSocket<_AF> {
         friend class TCPListenSocket<_AF>;
+        friend class UnixCommunicateSocket;
+    private:
+
+        // Consumes the caller's WSABUF array in place: fully transferred entries
+        // are left empty and a partly transferred one is moved past its bytes, so
+        // the same array can be passed again to resume an interrupted transfer.
+        static void AdvanceBuffers(WSABUF*& buffers, int& count, DWORD length) {
+            while (count > 0 && length >= buffers->len) {
+                length -= buffers->len;
+                buffers->buf += buffers->len;
+                buffers->len = 0;
+                ++buffers;
+                --count;
+            }
+            if (count > 0) {
+                buffers->buf += length;
+                buffers->len -= length;
+            }
+        }
+
     protected:
 
         TCPCommunicateSocket(SOCKET new_descriptor) : TCPSocket(new_descriptor) { }
@@ -135,28 +198,24 @@ namespace tinySocket {
             return *this;
         }
 
-        void Connect(const TCHAR* HostName, u_short Port) const throw(DWORD) {
-            ADDRINFOT hints = { };
-            hints.ai_family = _AF;
-            hints.ai_socktype = SOCK_STREAM;
-            hints.ai_protocol = IPPROTO_TCP;
-            
-            ADDRINFOT* result = nullptr;
-
-            int status = GetAddrInfo(HostName, nullptr, &hints, &result);
-            if (status != 0)
-                throw status;
+        void Connect(const SocketAddr<_AF>& to) const throw(DWORD) {
+            if (::connect(_descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) != 0)
+                throw WSAGetLastError();
+        }
 
-            if (_AF == AF_INET) {
-                reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_port = htons(Port);
-            } else if (_AF == AF_INET6) {
-                reinterpret_cast<sockaddr_in6*>(result->ai_addr)->sin6_port = htons(Port);
+        void Connect(Resolver<_AF>& resolver, const TCHAR* HostName, u_short Port) const throw(DWORD) {
+            typename Resolver<_AF>::AddressList addresses = resolver.Resolve(HostName, Port);
+            DWORD error = WSAHOST_NOT_FOUND;
+            for (const SocketAddr<_AF>& to : addresses) {
+                if (::connect(_descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) == 0)
+                    return;
+                error = WSAGetLastError();
             }
+            throw error;
+        }
 
-            status = ::connect(_descriptor, result->ai_addr, result->ai_addrlen);
-            FreeAddrInfo(result);
-            if (status != 0)
-                throw WSAGetLastError();
+        void Connect(const TCHAR* HostName, u_short Port) const throw(DWORD) {
+            Connect(Resolver<_AF>::Default(), HostName, Port);
         }
 
         void Connect(const TCHAR* HostName, const TCHAR* ServiceName) const throw(DWORD) {
@@ -183,20 +242,159 @@ namespace tinySocket {
                 throw WSAGetLastError();
         }
 
-        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+        Result<int> TrySend(const void* buffer, int length, int flag = 0) const {
             int sent_length = ::send(_descriptor, reinterpret_cast<const char*>(buffer), length, flag);
-            if (sent_length == SOCKET_ERROR)
-                throw WSAGetLastError();
+            DWORD error = sent_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, length, sent_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
             return sent_length;
         }
 
-        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+        Result<int> TryReceive(void* buffer, int length, int flag = 0) const {
             int received_length = ::recv(_descriptor, reinterpret_cast<char*>(buffer), length, flag);
-            if (received_length == SOCKET_ERROR)
-                throw WSAGetLastError();
+            DWORD error = received_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, length, received_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
             return received_length;
         }
 
+        Result<int> TrySend(const WSABUF* buffers, int count, int flag = 0) const {
+            DWORD sent_length = 0;
+            DWORD error = ::WSASend(_descriptor, const_cast<WSABUF*>(buffers), count,
+                                    &sent_length, flag, nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, Instrumentation::Length(buffers, count),
+                                        static_cast<int>(sent_length), error);
+            if (error != 0)
+                return Result<int>::Error(error);
+            return static_cast<int>(sent_length);
+        }
+
+        Result<int> TryReceive(WSABUF* buffers, int count, int flag = 0) const {
+            DWORD received_length = 0;
+            DWORD flags = flag;
+            DWORD error = ::WSARecv(_descriptor, buffers, count,
+                                    &received_length, &flags, nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, Instrumentation::Length(buffers, count),
+                                           static_cast<int>(received_length), error);
+            if (error != 0)
+                return Result<int>::Error(error);
+            return static_cast<int>(received_length);
+        }
+
+        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TrySend(buffer, length, flag).Value();
+        }
+
+        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceive(buffer, length, flag).Value();
+        }
+
+        int Send(const WSABUF* buffers, int count, int flag = 0) const throw(DWORD) {
+            return TrySend(buffers, count, flag).Value();
+        }
+
+        int Receive(WSABUF* buffers, int count, int flag = 0) const throw(DWORD) {
+            return TryReceive(buffers, count, flag).Value();
+        }
+
+        //----------------------------
+        //  SendAll / ReceiveExact
+        //----------------------------
+        //  On a non-blocking socket these may throw WSAEWOULDBLOCK part way
+        //  through. *transferred, when given, always holds the bytes moved so far,
+        //  and the WSABUF overloads advance the caller's array (see AdvanceBuffers)
+        //  so calling again with the same array continues the transfer.
+
+        int SendAll(const void* buffer, int length, int flag = 0, int* transferred = nullptr) const throw(DWORD) {
+            WSABUF data;
+            data.buf = const_cast<char*>(reinterpret_cast<const char*>(buffer));
+            data.len = length;
+            return SendAll(&data, 1, flag, transferred);
+        }
+
+        int SendAll(WSABUF* buffers, int count, int flag = 0, int* transferred = nullptr) const throw(DWORD) {
+            int total = 0;
+            if (transferred != nullptr)
+                *transferred = 0;
+            while (count > 0) {
+                int sent_length = Send(buffers, count, flag);
+                total += sent_length;
+                if (transferred != nullptr)
+                    *transferred = total;
+                AdvanceBuffers(buffers, count, sent_length);
+            }
+            return total;
+        }
+
+        int ReceiveExact(void* buffer, int length, int flag = 0, int* transferred = nullptr) const throw(DWORD) {
+            WSABUF data;
+            data.buf = reinterpret_cast<char*>(buffer);
+            data.len = length;
+            return ReceiveExact(&data, 1, flag, transferred);
+        }
+
+        int ReceiveExact(WSABUF* buffers, int count, int flag = 0, int* transferred = nullptr) const throw(DWORD) {
+            int total = 0;
+            if (transferred != nullptr)
+                *transferred = 0;
+            while (count > 0) {
+                int received_length = Receive(buffers, count, flag);
+                if (received_length == 0)
+                    throw WSAEDISCON;
+                total += received_length;
+                if (transferred != nullptr)
+                    *transferred = total;
+                AdvanceBuffers(buffers, count, received_length);
+            }
+            return total;
+        }
+
+        //----------------------------
+        //  TransmitFile
+        //----------------------------
+
+        DWORD SendFile(HANDLE file, ULONGLONG offset, DWORD length, DWORD flag = 0) const throw(DWORD) {
+            HANDLE event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+            if (event == nullptr)
+                throw ::GetLastError();
+
+            OVERLAPPED overlapped = { };
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            overlapped.hEvent = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(event) | 1);
+
+            if (!::TransmitFile(_descriptor, file, length, 0, &overlapped, nullptr, flag)) {
+                DWORD error = WSAGetLastError();
+                if (error != WSA_IO_PENDING) {
+                    ::CloseHandle(event);
+                    throw error;
+                }
+            }
+
+            DWORD sent_length = 0;
+            DWORD flags = 0;
+            BOOL status = ::WSAGetOverlappedResult(_descriptor, &overlapped, &sent_length, TRUE, &flags);
+            DWORD error = status ? 0 : WSAGetLastError();
+            ::CloseHandle(event);
+            if (!status)
+                throw error;
+            return sent_length;
+        }
+
+        //----------------------------
+        //  SO_SNDBUF = 0
+        //----------------------------
+
+        void EnableZeroCopySend() const throw(DWORD) {
+            int size = 0;
+            if (::setsockopt(_descriptor,
+                             SOL_SOCKET, SO_SNDBUF,
+                             reinterpret_cast<const char*>(&size), sizeof(size)) != 0)
+                throw WSAGetLastError();
+        }
+
     };
 
     template<int _AF>
@@ -208,6 +406,11 @@ namespace tinySocket {
 
     public:
 
+        struct AcceptInfo {
+            TCPCommunicateSocket<_AF> socket;
+            SocketAddr<_AF> from;
+        };
+
         TCPListenSocket() : TCPSocket() { }
 
         TCPListenSocket(const TCPListenSocket<_AF>&) = delete;
@@ -227,11 +430,44 @@ namespace tinySocket {
                 throw WSAGetLastError();
         }
 
-        TCPCommunicateSocket<_AF> Accept() const throw(DWORD) {
+        Result<TCPCommunicateSocket<_AF>> TryAccept() const {
             SOCKET s = ::accept(_descriptor, nullptr, nullptr);
             if (s == INVALID_SOCKET)
-                throw WSAGetLastError();
-            return s;
+                return Result<TCPCommunicateSocket<_AF>>::Error(WSAGetLastError());
+            return TCPCommunicateSocket<_AF>(s);
+        }
+
+        TCPCommunicateSocket<_AF> Accept() const throw(DWORD) {
+            return std::move(TryAccept().Value());
+        }
+
+        // Only the first accept may block. Winsock cannot report whether FIONBIO is
+        // set, so further accepts are made only while the backlog polls readable,
+        // which keeps a blocking listener from stalling a reactor thread.
+        int AcceptMany(std::vector<AcceptInfo>& accepted, int max_count) const throw(DWORD) {
+            int count = 0;
+            while (count < max_count) {
+                if (count != 0) {
+                    WSAPOLLFD pollfd = { };
+                    pollfd.fd = _descriptor;
+                    pollfd.events = POLLRDNORM;
+                    if (::WSAPoll(&pollfd, 1, 0) <= 0 || (pollfd.revents & POLLRDNORM) == 0)
+                        break;
+                }
+
+                SocketAddr<_AF> from;
+                int from_size = sizeof(from);
+                SOCKET s = ::accept(_descriptor, reinterpret_cast<sockaddr*>(&from), &from_size);
+                if (s == INVALID_SOCKET) {
+                    DWORD error = WSAGetLastError();
+                    if (error == WSAEWOULDBLOCK || count != 0)
+                        break;
+                    throw error;
+                }
+                accepted.push_back(AcceptInfo { TCPCommunicateSocket<_AF>(s), from });
+                ++count;
+            }
+            return count;
         }
 
     };
@@ -0,0 +1,240 @@
+#pragma once
+#include <Windows.h>
+#include <functional>
+
+namespace tinySocket {
+
+    class TimerWheel;
+
+    class Timer {
+        friend class TimerWheel;
+    public:
+
+        typedef std::function<void()> Callback;
+
+    private:
+        TimerWheel* _wheel;
+        Timer* _prev;
+        Timer* _next;
+        Timer** _slot;
+        ULONGLONG _expiry;
+        Callback _callback;
+        // Set while the callback runs, so the wheel can tell whether the
+        // callback destroyed its own timer.
+        bool* _destroyed;
+
+    public:
+
+        Timer() : _wheel(nullptr), _prev(nullptr), _next(nullptr), _slot(nullptr), _expiry(0), _destroyed(nullptr) { }
+
+        Timer(Callback callback) :
+            _wheel(nullptr), _prev(nullptr), _next(nullptr), _slot(nullptr), _expiry(0),
+            _callback(std::move(callback)), _destroyed(nullptr) { }
+
+        Timer(const Timer&) = delete;
+
+        Timer& operator=(const Timer&) = delete;
+
+        inline ~Timer();
+
+        void SetCallback(Callback callback) {
+            _callback = std::move(callback);
+        }
+
+        bool IsPending() const {
+            return _slot != nullptr;
+        }
+
+        ULONGLONG GetExpiry() const {
+            return _expiry;
+        }
+
+        inline void Cancel();
+
+    };
+
+    class TimerWheel {
+    public:
+
+        static const int SlotBits = 8;
+        static const int SlotCount = 1 << SlotBits;
+        static const int LevelCount = 4;
+        static const ULONGLONG MaximumDelay = (1ULL << (SlotBits * LevelCount)) - 1;
+
+    private:
+        Timer* _slots[LevelCount][SlotCount];
+        ULONGLONG _now;
+        size_t _count;
+
+        static ULONGLONG Now() {
+            return ::GetTickCount64();
+        }
+
+        void Link(Timer& timer) {
+            ULONGLONG delta = timer._expiry - _now;
+            int level = 0;
+            while (level < LevelCount - 1 && delta >= (1ULL << (SlotBits * (level + 1))))
+                ++level;
+
+            Timer** slot = &_slots[level][(timer._expiry >> (SlotBits * level)) & (SlotCount - 1)];
+            timer._prev = nullptr;
+            timer._next = *slot;
+            if (*slot != nullptr)
+                (*slot)->_prev = &timer;
+            *slot = &timer;
+            timer._slot = slot;
+        }
+
+        void Unlink(Timer& timer) {
+            if (timer._prev != nullptr)
+                timer._prev->_next = timer._next;
+            else
+                *timer._slot = timer._next;
+            if (timer._next != nullptr)
+                timer._next->_prev = timer._prev;
+            timer._prev = nullptr;
+            timer._next = nullptr;
+            timer._slot = nullptr;
+        }
+
+        void Cascade(int level) {
+            Timer* timer = _slots[level][(_now >> (SlotBits * level)) & (SlotCount - 1)];
+            _slots[level][(_now >> (SlotBits * level)) & (SlotCount - 1)] = nullptr;
+            while (timer != nullptr) {
+                Timer* next = timer->_next;
+                Link(*timer);
+                timer = next;
+            }
+        }
+
+        size_t Tick() {
+            ++_now;
+            for (int level = 1; level < LevelCount; ++level) {
+                if ((_now & ((1ULL << (SlotBits * level)) - 1)) != 0)
+                    break;
+                Cascade(level);
+            }
+
+            size_t fired = 0;
+            Timer** slot = &_slots[0][_now & (SlotCount - 1)];
+            while (*slot != nullptr) {
+                Timer& timer = **slot;
+                Unlink(timer);
+                timer._wheel = nullptr;
+                --_count;
+                ++fired;
+                if (!timer._callback)
+                    continue;
+
+                // The callback may destroy the timer that owns it, so it runs from
+                // a local and is handed back only if the timer is still alive and
+                // no new callback was set meanwhile.
+                bool destroyed = false;
+                timer._destroyed = &destroyed;
+                Timer::Callback callback = std::move(timer._callback);
+                timer._callback = nullptr;
+                callback();
+                if (destroyed)
+                    continue;
+                timer._destroyed = nullptr;
+                if (!timer._callback)
+                    timer._callback = std::move(callback);
+            }
+            return fired;
+        }
+
+    public:
+
+        TimerWheel() : _slots(), _now(Now()), _count(0) { }
+
+        TimerWheel(const TimerWheel&) = delete;
+
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        ~TimerWheel() {
+            for (int level = 0; level < LevelCount; ++level) {
+                for (int i = 0; i < SlotCount; ++i) {
+                    while (_slots[level][i] != nullptr) {
+                        Timer& timer = *_slots[level][i];
+                        Unlink(timer);
+                        timer._wheel = nullptr;
+                    }
+                }
+            }
+        }
+
+        size_t GetCount() const {
+            return _count;
+        }
+
+        void Schedule(Timer& timer, ULONGLONG delay) {
+            if (timer._wheel != nullptr)
+                timer._wheel->Cancel(timer);
+
+            ULONGLONG now = Now();
+            ULONGLONG expiry = (now > _now ? now : _now) + (delay > MaximumDelay ? MaximumDelay : delay);
+            if (expiry - _now > MaximumDelay)
+                expiry = _now + MaximumDelay;
+            timer._expiry = expiry > _now ? expiry : _now + 1;
+            timer._wheel = this;
+            Link(timer);
+            ++_count;
+        }
+
+        void Cancel(Timer& timer) {
+            if (timer._wheel != this)
+                return;
+            Unlink(timer);
+            timer._wheel = nullptr;
+            --_count;
+        }
+
+        size_t Advance() {
+            return Advance(Now());
+        }
+
+        size_t Advance(ULONGLONG now) {
+            size_t fired = 0;
+            while (_now < now) {
+                if (_count == 0) {
+                    _now = now;
+                    break;
+                }
+                fired += Tick();
+            }
+            return fired;
+        }
+
+        INT GetTimeout(INT timeout = -1) const {
+            if (_count == 0)
+                return timeout;
+
+            ULONGLONG target = (_now | (SlotCount - 1)) + 1;
+            for (ULONGLONG tick = _now + 1; tick < target; ++tick) {
+                if (_slots[0][tick & (SlotCount - 1)] != nullptr) {
+                    target = tick;
+                    break;
+                }
+            }
+
+            ULONGLONG now = Now();
+            ULONGLONG remaining = target > now ? target - now : 0;
+            if (timeout >= 0 && remaining > static_cast<ULONGLONG>(timeout))
+                return timeout;
+            return static_cast<INT>(remaining);
+        }
+
+    };
+
+    inline Timer::~Timer() {
+        if (_destroyed != nullptr)
+            *_destroyed = true;
+        Cancel();
+    }
+
+    inline void Timer::Cancel() {
+        if (_wheel != nullptr)
+            _wheel->Cancel(*this);
+    }
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "Socket.hpp"
+#include <vector>
+#include <cstring>
+
+namespace tinySocket {
+
+    class TuningProfile {
+    private:
+
+        struct Setting {
+            int level;
+            int name;
+            int length;
+            char value[16];
+        };
+
+        std::vector<Setting> _settings;
+
+        static bool Applies(int level, int family, int protocol) {
+            if (level == IPPROTO_TCP || level == IPPROTO_UDP)
+                return level == protocol;
+            if (level == IPPROTO_IP)
+                return family == AF_INET;
+            if (level == IPPROTO_IPV6)
+                return family == AF_INET6;
+            return true;
+        }
+
+    public:
+
+        template<typename _Option>
+        TuningProfile& With(const typename _Option::ValueType& value) {
+            static_assert(sizeof(value) <= sizeof(Setting().value), "socket option value too large");
+            Setting setting = { };
+            setting.level = _Option::Level;
+            setting.name = _Option::Name;
+            setting.length = sizeof(value);
+            memcpy(setting.value, &value, sizeof(value));
+            _settings.push_back(setting);
+            return *this;
+        }
+
+        template<int _AF, int _SocketType, int _Protocol>
+        void Apply(const Socket<_AF, _SocketType, _Protocol>& socket) const throw(DWORD) {
+            for (const Setting& setting : _settings) {
+                if (Applies(setting.level, _AF, _Protocol))
+                    socket.SetSocketOption(setting.level, setting.name, setting.value, setting.length);
+            }
+        }
+
+        bool IsEmpty() const {
+            return _settings.empty();
+        }
+
+        //----------------------------
+        //  Profiles
+        //----------------------------
+
+        static TuningProfile LowLatency() {
+            TuningProfile profile;
+            profile.With<Option::NoDelay>(TRUE)
+                   .With<Option::SendBuffer>(32 * 1024)
+                   .With<Option::ReceiveBuffer>(32 * 1024);
+            return profile;
+        }
+
+        static TuningProfile BulkThroughput() {
+            TuningProfile profile;
+            profile.With<Option::NoDelay>(FALSE)
+                   .With<Option::SendBuffer>(4 * 1024 * 1024)
+                   .With<Option::ReceiveBuffer>(4 * 1024 * 1024);
+            return profile;
+        }
+
+    };
+
+}
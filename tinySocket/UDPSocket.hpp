@@ -1,5 +1,9 @@
 #pragma once
 #include "Socket.hpp"
+#include "Resolver.hpp"
+#include <MSWSock.h>
+
+#pragma comment(lib, "Mswsock.lib")
 
 namespace tinySocket {
 
@@ -44,6 +48,56 @@ namespace tinySocket {
                 throw WSAGetLastError();
         }
 
+        static LPFN_WSARECVMSG LoadReceiveMessage(SOCKET descriptor) throw(DWORD) {
+            GUID guid = WSAID_WSARECVMSG;
+            LPFN_WSARECVMSG function = nullptr;
+            DWORD bytes = 0;
+            if (::WSAIoctl(descriptor, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                           &guid, sizeof(guid), &function, sizeof(function),
+                           &bytes, nullptr, nullptr) != 0)
+                throw WSAGetLastError();
+            return function;
+        }
+
+        int SendWithControl(const void* buffer, int length, const sockaddr* to, int to_size,
+                            int level, int type, DWORD value, int flag) const throw(DWORD) {
+            WSABUF data;
+            data.buf = const_cast<char*>(reinterpret_cast<const char*>(buffer));
+            data.len = length;
+
+            char control[WSA_CMSG_SPACE(sizeof(DWORD))] = { };
+            WSAMSG msg = { };
+            msg.name = const_cast<sockaddr*>(to);
+            msg.namelen = to_size;
+            msg.lpBuffers = &data;
+            msg.dwBufferCount = 1;
+            msg.Control.buf = control;
+            msg.Control.len = sizeof(control);
+
+            WSACMSGHDR* cmsg = WSA_CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = level;
+            cmsg->cmsg_type = type;
+            cmsg->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+            *reinterpret_cast<DWORD*>(WSA_CMSG_DATA(cmsg)) = value;
+
+            DWORD sent_length = 0;
+            DWORD error = ::WSASendMsg(_descriptor, &msg, flag, &sent_length, nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, length, static_cast<int>(sent_length), error);
+            if (error != 0)
+                throw error;
+            return static_cast<int>(sent_length);
+        }
+
+        bool WaitReadable(INT timeout) const throw(DWORD) {
+            WSAPOLLFD pollfd = { };
+            pollfd.fd = _descriptor;
+            pollfd.events = POLLRDNORM;
+            int ready = ::WSAPoll(&pollfd, 1, timeout);
+            if (ready == SOCKET_ERROR)
+                throw WSAGetLastError();
+            return ready != 0;
+        }
+
     protected:
 
         UDPSocket(SOCKET new_descriptor) : Socket(new_descriptor) { }
@@ -53,6 +107,8 @@ namespace tinySocket {
         struct ReceiveInfo {
             int length;
             SocketAddr<_AF> from;
+            DWORD segment_size;
+            ULONGLONG timestamp;
         };
 
         UDPSocket() : Socket() { }
@@ -90,28 +146,24 @@ namespace tinySocket {
             Bind<_AF>(LocalAddress, LocalPort);
         }
 
-        void Connect(const TCHAR* HostName, u_short Port) const throw(DWORD) {
-            ADDRINFOT hints = { };
-            hints.ai_family = _AF;
-            hints.ai_socktype = SOCK_DGRAM;
-            hints.ai_protocol = IPPROTO_UDP;
-
-            ADDRINFOT* result = nullptr;
-
-            int status = GetAddrInfo(HostName, nullptr, &hints, &result);
-            if (status != 0)
-                throw status;
+        void Connect(const SocketAddr<_AF>& to) const throw(DWORD) {
+            if (::connect(_descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) != 0)
+                throw WSAGetLastError();
+        }
 
-            if (_AF == AF_INET) {
-                reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_port = htons(Port);
-            } else if (_AF == AF_INET6) {
-                reinterpret_cast<sockaddr_in6*>(result->ai_addr)->sin6_port = htons(Port);
+        void Connect(Resolver<_AF>& resolver, const TCHAR* HostName, u_short Port) const throw(DWORD) {
+            typename Resolver<_AF>::AddressList addresses = resolver.Resolve(HostName, Port);
+            DWORD error = WSAHOST_NOT_FOUND;
+            for (const SocketAddr<_AF>& to : addresses) {
+                if (::connect(_descriptor, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) == 0)
+                    return;
+                error = WSAGetLastError();
             }
+            throw error;
+        }
 
-            status = ::connect(_descriptor, result->ai_addr, result->ai_addrlen);
-            FreeAddrInfo(result);
-            if (status != 0)
-                throw WSAGetLastError();
+        void Connect(const TCHAR* HostName, u_short Port) const throw(DWORD) {
+            Connect(Resolver<_AF>::Default(), HostName, Port);
         }
 
         void Connect(const TCHAR* HostName, const TCHAR* ServiceName) const throw(DWORD) {
@@ -138,68 +190,264 @@ namespace tinySocket {
                 throw WSAGetLastError();
         }
 
-        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+        Result<int> TrySend(const void* buffer, int length, int flag = 0) const {
             int sent_length = ::send(_descriptor, reinterpret_cast<const char*>(buffer), length, flag);
-            if (sent_length == SOCKET_ERROR)
-                throw WSAGetLastError();
+            DWORD error = sent_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, length, sent_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
             return sent_length;
         }
 
-        int SendTo(const void* buffer, int length, const SocketAddr<_AF>& to, int flag = 0) const throw(DWORD) {
+        Result<int> TrySendTo(const void* buffer, int length, const SocketAddr<_AF>& to, int flag = 0) const {
             int sent_length;
             sent_length = ::sendto(_descriptor,
                                    reinterpret_cast<const char*>(buffer), length,
                                    flag,
                                    reinterpret_cast<const sockaddr*>(&to), sizeof(to));
-            if (sent_length == SOCKET_ERROR)
-                throw WSAGetLastError();
+            DWORD error = sent_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, length, sent_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
             return sent_length;
         }
 
-        int SendTo(const void* buffer, int length, const TCHAR* hostname, u_short port, int flag /* = 0) const throw(DWORD */) {
-            ADDRINFOT hints = { };
-            hints.ai_family = _AF;
-            hints.ai_socktype = SOCK_DGRAM;
-            hints.ai_protocol = IPPROTO_UDP;
+        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TrySend(buffer, length, flag).Value();
+        }
 
-            ADDRINFOT* result = nullptr;
+        int SendTo(const void* buffer, int length, const SocketAddr<_AF>& to, int flag = 0) const throw(DWORD) {
+            return TrySendTo(buffer, length, to, flag).Value();
+        }
 
-            int status = GetAddrInfo(hostname, nullptr, &hints, &result);
-            if (status != 0)
-                throw status;
+        int Send(const WSABUF* buffers, int count, int flag = 0) const throw(DWORD) {
+            DWORD sent_length = 0;
+            DWORD error = ::WSASend(_descriptor, const_cast<WSABUF*>(buffers), count,
+                                    &sent_length, flag, nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, Instrumentation::Length(buffers, count),
+                                        static_cast<int>(sent_length), error);
+            if (error != 0)
+                throw error;
+            return static_cast<int>(sent_length);
+        }
 
-            if (_AF == AF_INET) {
-                reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_port = htons(Port);
-            } else if (_AF == AF_INET6) {
-                reinterpret_cast<sockaddr_in6*>(result->ai_addr)->sin6_port = htons(Port);
-            }
+        int SendTo(const WSABUF* buffers, int count, const SocketAddr<_AF>& to, int flag = 0) const throw(DWORD) {
+            DWORD sent_length = 0;
+            DWORD error = ::WSASendTo(_descriptor, const_cast<WSABUF*>(buffers), count, &sent_length, flag,
+                                      reinterpret_cast<const sockaddr*>(&to), sizeof(to), nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, Instrumentation::Length(buffers, count),
+                                        static_cast<int>(sent_length), error);
+            if (error != 0)
+                throw error;
+            return static_cast<int>(sent_length);
+        }
 
-            status = ::sendto(_descriptor, buffer, length, flag, result->ai_addr, result->ai_addrlen);
-            FreeAddrInfo(result);
+        int SendTo(const void* buffer, int length, Resolver<_AF>& resolver,
+                   const TCHAR* hostname, u_short port, int flag = 0) const throw(DWORD) {
+            return SendTo(buffer, length, resolver.ResolveOne(hostname, port), flag);
+        }
 
-            if (status != SOCKET_ERROR)
-                throw WSAGetLastError();
-            return status;
+        int SendTo(const void* buffer, int length, const TCHAR* hostname, u_short port, int flag = 0) const throw(DWORD) {
+            return SendTo(buffer, length, Resolver<_AF>::Default(), hostname, port, flag);
         }
 
-        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+        Result<int> TryReceive(void* buffer, int length, int flag = 0) const {
             int received_length = ::recv(_descriptor, reinterpret_cast<char*>(buffer), length, flag);
-            if (received_length == SOCKET_ERROR)
-                throw WSAGetLastError();
+            DWORD error = received_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, length, received_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
             return received_length;
         }
 
-        ReceiveInfo ReceiveFrom(void* buffer, int length, int flag = 0) const throw(DWORD) {
+        Result<ReceiveInfo> TryReceiveFrom(void* buffer, int length, int flag = 0) const {
             ReceiveInfo ret = { };
+            int from_size = sizeof(ret.from);
             ret.length = ::recvfrom(_descriptor,
                                     reinterpret_cast<char*>(buffer), length,
                                     flag,
-                                    reinterpret_cast<sockaddr*>(&ret.from), sizeof(ret.from));
-            if (ret.length == SOCKET_ERROR)
+                                    reinterpret_cast<sockaddr*>(&ret.from), &from_size);
+            DWORD error = ret.length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, length, ret.length, error);
+            if (error != 0)
+                return Result<ReceiveInfo>::Error(error);
+            return ret;
+        }
+
+        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceive(buffer, length, flag).Value();
+        }
+
+        ReceiveInfo ReceiveFrom(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceiveFrom(buffer, length, flag).Value();
+        }
+
+        //----------------------------
+        //  UDP_SEND_MSG_SIZE
+        //----------------------------
+
+        int SendSegmented(const void* buffer, int length, DWORD segment_size, int flag = 0) const throw(DWORD) {
+            return SendWithControl(buffer, length, nullptr, 0, IPPROTO_UDP, UDP_SEND_MSG_SIZE, segment_size, flag);
+        }
+
+        int SendToSegmented(const void* buffer, int length, const SocketAddr<_AF>& to,
+                            DWORD segment_size, int flag = 0) const throw(DWORD) {
+            return SendWithControl(buffer, length, reinterpret_cast<const sockaddr*>(&to), sizeof(to),
+                                   IPPROTO_UDP, UDP_SEND_MSG_SIZE, segment_size, flag);
+        }
+
+        //----------------------------
+        //  UDP_RECV_MAX_COALESCED_SIZE
+        //----------------------------
+
+        void SetReceiveCoalescing(DWORD max_size) const throw(DWORD) {
+            if (::setsockopt(_descriptor,
+                             IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                             reinterpret_cast<const char*>(&max_size), sizeof(max_size)) != 0)
                 throw WSAGetLastError();
+        }
+
+        DWORD GetReceiveCoalescing() const throw(DWORD) {
+            DWORD max_size;
+            int max_size_length = sizeof(max_size);
+            if (::getsockopt(_descriptor,
+                             IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                             reinterpret_cast<char*>(&max_size), &max_size_length) != 0)
+                throw WSAGetLastError();
+            return max_size;
+        }
+
+        ReceiveInfo ReceiveMessage(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            static LPFN_WSARECVMSG receive_message = LoadReceiveMessage(_descriptor);
+
+            ReceiveInfo ret = { };
+            WSABUF data;
+            data.buf = reinterpret_cast<char*>(buffer);
+            data.len = length;
+
+            char control[WSA_CMSG_SPACE(sizeof(DWORD)) + WSA_CMSG_SPACE(sizeof(UINT64))] = { };
+            WSAMSG msg = { };
+            msg.name = reinterpret_cast<sockaddr*>(&ret.from);
+            msg.namelen = sizeof(ret.from);
+            msg.lpBuffers = &data;
+            msg.dwBufferCount = 1;
+            msg.Control.buf = control;
+            msg.Control.len = sizeof(control);
+            msg.dwFlags = flag;
+
+            DWORD received_length = 0;
+            DWORD error = receive_message(_descriptor, &msg, &received_length, nullptr, nullptr) != 0 ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, length, static_cast<int>(received_length), error);
+            if (error != 0)
+                throw error;
+            ret.length = static_cast<int>(received_length);
+
+            for (WSACMSGHDR* cmsg = WSA_CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = WSA_CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_COALESCED_INFO)
+                    ret.segment_size = *reinterpret_cast<DWORD*>(WSA_CMSG_DATA(cmsg));
+                else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP)
+                    ret.timestamp = *reinterpret_cast<UINT64*>(WSA_CMSG_DATA(cmsg));
+            }
             return ret;
         }
 
+        //----------------------------
+        //  SIO_TIMESTAMPING
+        //----------------------------
+
+        void SetTimestamping(bool receive, bool send, USHORT send_buffered = 0) const throw(DWORD) {
+            TIMESTAMPING_CONFIG config = { };
+            config.Flags = (receive ? TIMESTAMPING_FLAG_RX : 0) | (send ? TIMESTAMPING_FLAG_TX : 0);
+            config.TxTimestampsBuffered = send ? send_buffered : 0;
+            DWORD bytes = 0;
+            if (::WSAIoctl(_descriptor, SIO_TIMESTAMPING, &config, sizeof(config),
+                           nullptr, 0, &bytes, nullptr, nullptr) != 0)
+                throw WSAGetLastError();
+        }
+
+        int SendTimestamped(const void* buffer, int length, UINT32 id, int flag = 0) const throw(DWORD) {
+            return SendWithControl(buffer, length, nullptr, 0, SOL_SOCKET, SO_TIMESTAMP_ID, id, flag);
+        }
+
+        int SendToTimestamped(const void* buffer, int length, const SocketAddr<_AF>& to,
+                              UINT32 id, int flag = 0) const throw(DWORD) {
+            return SendWithControl(buffer, length, reinterpret_cast<const sockaddr*>(&to), sizeof(to),
+                                   SOL_SOCKET, SO_TIMESTAMP_ID, id, flag);
+        }
+
+        Result<ULONGLONG> TryGetSendTimestamp(UINT32 id) const {
+            UINT64 timestamp = 0;
+            DWORD bytes = 0;
+            if (::WSAIoctl(_descriptor, SIO_GET_TX_TIMESTAMP, &id, sizeof(id),
+                           &timestamp, sizeof(timestamp), &bytes, nullptr, nullptr) != 0)
+                return Result<ULONGLONG>::Error(WSAGetLastError());
+            return static_cast<ULONGLONG>(timestamp);
+        }
+
+        int SendMany(const WSABUF* buffers, const SocketAddr<_AF>* to, int count, int flag = 0) const throw(DWORD) {
+            int sent = 0;
+            while (sent < count) {
+                int sent_length = ::sendto(_descriptor,
+                                           buffers[sent].buf, buffers[sent].len,
+                                           flag,
+                                           reinterpret_cast<const sockaddr*>(&to[sent]), sizeof(to[sent]));
+                DWORD error = sent_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+                Instrumentation::RecordSend(_descriptor, buffers[sent].len, sent_length, error);
+                if (error != 0) {
+                    if (sent != 0)
+                        break;
+                    throw error;
+                }
+                ++sent;
+            }
+            return sent;
+        }
+
+        // Works on blocking and non-blocking sockets alike: once min_count datagrams
+        // are in, or while a timeout is running, the socket is polled before each
+        // recvfrom so a blocking receive never outlives the call's deadline.
+        int ReceiveMany(WSABUF* buffers, ReceiveInfo* results, int count,
+                        int min_count = 1, INT timeout = -1, int flag = 0) const throw(DWORD) {
+            ULONGLONG deadline = ::GetTickCount64() + (timeout < 0 ? 0 : timeout);
+            int received = 0;
+            while (received < count) {
+                INT wait = -1;
+                if (received >= min_count) {
+                    wait = 0;
+                } else if (timeout >= 0) {
+                    ULONGLONG now = ::GetTickCount64();
+                    wait = now >= deadline ? 0 : static_cast<INT>(deadline - now);
+                }
+                if (wait >= 0 && !WaitReadable(wait))
+                    break;
+
+                int from_size = sizeof(results[received].from);
+                int received_length = ::recvfrom(_descriptor,
+                                                 buffers[received].buf, buffers[received].len,
+                                                 flag,
+                                                 reinterpret_cast<sockaddr*>(&results[received].from), &from_size);
+                DWORD error = received_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+                Instrumentation::RecordReceive(_descriptor, buffers[received].len, received_length, error);
+                if (error == 0) {
+                    results[received].length = received_length;
+                    results[received].segment_size = 0;
+                    results[received].timestamp = 0;
+                    ++received;
+                    continue;
+                }
+
+                if (error == WSAEWOULDBLOCK) {
+                    if (wait < 0)
+                        WaitReadable(-1);
+                    continue;
+                }
+                if (received != 0)
+                    break;
+                throw error;
+            }
+            return received;
+        }
+
     };
 
 }
\ No newline at end of file
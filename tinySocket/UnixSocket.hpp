@@ -0,0 +1,296 @@
+#pragma once
+#include "TCPSocket.hpp"
+#include <afunix.h>
+#include <bcrypt.h>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <utility>
+
+#pragma comment(lib, "Bcrypt.lib")
+
+namespace tinySocket {
+
+    template<>
+    struct SocketAddr<AF_UNIX> : public sockaddr_un {
+
+        SocketAddr() { }
+
+        SocketAddr(const TCHAR* Path) {
+            Assign(Path, 0);
+        }
+
+        static SocketAddr<AF_UNIX> Abstract(const TCHAR* Name) {
+            SocketAddr<AF_UNIX> address;
+            address.Assign(Name, 1);
+            return address;
+        }
+
+        bool IsAbstract() const {
+            return sun_path[0] == '\0' && sun_path[1] != '\0';
+        }
+
+        int GetLength() const {
+            size_t offset = IsAbstract() ? 1 : 0;
+            size_t length = strnlen(sun_path + offset, sizeof(sun_path) - offset);
+            return static_cast<int>(offsetof(sockaddr_un, sun_path) + offset + length + (IsAbstract() ? 0 : 1));
+        }
+
+    private:
+
+        void Assign(const TCHAR* Path, size_t offset) {
+            memset(static_cast<sockaddr_un*>(this), 0, sizeof(sockaddr_un));
+            sun_family = AF_UNIX;
+#ifdef UNICODE
+            int length = ::WideCharToMultiByte(CP_UTF8, 0, Path, -1, sun_path + offset,
+                                               static_cast<int>(sizeof(sun_path) - offset), nullptr, nullptr);
+            if (length == 0)
+                throw WSAENAMETOOLONG;
+#else
+            size_t length = strlen(Path);
+            if (length + offset >= sizeof(sun_path))
+                throw WSAENAMETOOLONG;
+            memcpy(sun_path + offset, Path, length);
+#endif
+        }
+
+    };
+
+    class UnixSocket : public Socket<AF_UNIX, SOCK_STREAM, 0> {
+    protected:
+
+        UnixSocket(SOCKET new_descriptor) : Socket(new_descriptor) { }
+
+    public:
+
+        UnixSocket() : Socket() { }
+
+        UnixSocket(const UnixSocket&) = delete;
+
+        UnixSocket(UnixSocket&& other) :
+            Socket(static_cast<Socket<AF_UNIX, SOCK_STREAM, 0>&&>(other)) { }
+
+        UnixSocket& operator=(const UnixSocket&) = delete;
+
+        UnixSocket& operator=(UnixSocket&& other) {
+            Socket<AF_UNIX, SOCK_STREAM, 0>::operator=(static_cast<Socket<AF_UNIX, SOCK_STREAM, 0>&&>(other));
+            return *this;
+        }
+
+        void Bind(const SocketAddr<AF_UNIX>& address) const throw(DWORD) {
+            if (::bind(_descriptor, reinterpret_cast<const sockaddr*>(&address), address.GetLength()) != 0)
+                throw WSAGetLastError();
+        }
+
+        void Bind(const TCHAR* Path) const throw(DWORD) {
+            Bind(SocketAddr<AF_UNIX>(Path));
+        }
+
+    };
+
+    class UnixListenSocket;
+
+    class UnixCommunicateSocket : public UnixSocket {
+        friend class UnixListenSocket;
+    protected:
+
+        UnixCommunicateSocket(SOCKET new_descriptor) : UnixSocket(new_descriptor) { }
+
+    public:
+
+        UnixCommunicateSocket() : UnixSocket() { }
+
+        UnixCommunicateSocket(const UnixCommunicateSocket&) = delete;
+
+        UnixCommunicateSocket(UnixCommunicateSocket&& other) :
+            UnixSocket(static_cast<UnixSocket&&>(other)) { }
+
+        UnixCommunicateSocket& operator=(const UnixCommunicateSocket&) = delete;
+
+        UnixCommunicateSocket& operator=(UnixCommunicateSocket&& other) {
+            UnixSocket::operator=(static_cast<UnixSocket&&>(other));
+            return *this;
+        }
+
+        void Connect(const SocketAddr<AF_UNIX>& to) const throw(DWORD) {
+            if (::connect(_descriptor, reinterpret_cast<const sockaddr*>(&to), to.GetLength()) != 0)
+                throw WSAGetLastError();
+        }
+
+        void Connect(const TCHAR* Path) const throw(DWORD) {
+            Connect(SocketAddr<AF_UNIX>(Path));
+        }
+
+        Result<int> TrySend(const void* buffer, int length, int flag = 0) const {
+            int sent_length = ::send(_descriptor, reinterpret_cast<const char*>(buffer), length, flag);
+            DWORD error = sent_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordSend(_descriptor, length, sent_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
+            return sent_length;
+        }
+
+        Result<int> TryReceive(void* buffer, int length, int flag = 0) const {
+            int received_length = ::recv(_descriptor, reinterpret_cast<char*>(buffer), length, flag);
+            DWORD error = received_length == SOCKET_ERROR ? WSAGetLastError() : 0;
+            Instrumentation::RecordReceive(_descriptor, length, received_length, error);
+            if (error != 0)
+                return Result<int>::Error(error);
+            return received_length;
+        }
+
+        int Send(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TrySend(buffer, length, flag).Value();
+        }
+
+        int Receive(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            return TryReceive(buffer, length, flag).Value();
+        }
+
+        int SendAll(const void* buffer, int length, int flag = 0) const throw(DWORD) {
+            const char* data = reinterpret_cast<const char*>(buffer);
+            int total = 0;
+            while (total < length)
+                total += Send(data + total, length - total, flag);
+            return total;
+        }
+
+        int ReceiveExact(void* buffer, int length, int flag = 0) const throw(DWORD) {
+            char* data = reinterpret_cast<char*>(buffer);
+            int total = 0;
+            while (total < length) {
+                int received_length = Receive(data + total, length - total, flag);
+                if (received_length == 0)
+                    throw WSAEDISCON;
+                total += received_length;
+            }
+            return total;
+        }
+
+        //----------------------------
+        //  SIO_AF_UNIX_GETPEERPID
+        //----------------------------
+
+        DWORD GetPeerProcessId() const throw(DWORD) {
+            ULONG pid = 0;
+            DWORD bytes = 0;
+            if (::WSAIoctl(_descriptor, SIO_AF_UNIX_GETPEERPID, nullptr, 0,
+                           &pid, sizeof(pid), &bytes, nullptr, nullptr) != 0)
+                throw WSAGetLastError();
+            return pid;
+        }
+
+        //----------------------------
+        //  WSADuplicateSocket
+        //----------------------------
+
+        template<int _AF>
+        void SendSocket(const TCPCommunicateSocket<_AF>& socket) const throw(DWORD) {
+            WSAPROTOCOL_INFOW info = { };
+            if (::WSADuplicateSocketW(socket.GetDescriptor(), GetPeerProcessId(), &info) != 0)
+                throw WSAGetLastError();
+            SendAll(&info, sizeof(info));
+        }
+
+        template<int _AF>
+        TCPCommunicateSocket<_AF> ReceiveSocket() const throw(DWORD) {
+            WSAPROTOCOL_INFOW info = { };
+            ReceiveExact(&info, sizeof(info));
+            if (info.iAddressFamily != _AF || info.iSocketType != SOCK_STREAM)
+                throw WSAEAFNOSUPPORT;
+
+            SOCKET s = ::WSASocketW(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO,
+                                    &info, 0, WSA_FLAG_OVERLAPPED);
+            if (s == INVALID_SOCKET)
+                throw WSAGetLastError();
+            return TCPCommunicateSocket<_AF>(s);
+        }
+
+    };
+
+    class UnixListenSocket : public UnixSocket {
+        friend class UnixCommunicateSocket;
+    protected:
+
+        UnixListenSocket(SOCKET new_descriptor) : UnixSocket(new_descriptor) { }
+
+    public:
+
+        UnixListenSocket() : UnixSocket() { }
+
+        UnixListenSocket(const UnixListenSocket&) = delete;
+
+        UnixListenSocket(UnixListenSocket&& other) :
+            UnixSocket(static_cast<UnixSocket&&>(other)) { }
+
+        UnixListenSocket& operator=(const UnixListenSocket&) = delete;
+
+        UnixListenSocket& operator=(UnixListenSocket&& other) {
+            UnixSocket::operator=(static_cast<UnixSocket&&>(other));
+            return *this;
+        }
+
+        void Listen(int backlog) const throw(DWORD) {
+            if (::listen(_descriptor, backlog) != 0)
+                throw WSAGetLastError();
+        }
+
+        Result<UnixCommunicateSocket> TryAccept() const {
+            SOCKET s = ::accept(_descriptor, nullptr, nullptr);
+            if (s == INVALID_SOCKET)
+                return Result<UnixCommunicateSocket>::Error(WSAGetLastError());
+            return UnixCommunicateSocket(s);
+        }
+
+        UnixCommunicateSocket Accept() const throw(DWORD) {
+            return std::move(TryAccept().Value());
+        }
+
+    };
+
+    //----------------------------
+    //  socketpair
+    //----------------------------
+
+    // The rendezvous name is unpredictable, and the accepted end must belong to
+    // this process, so another local process cannot slip in as the pair.
+    inline std::pair<UnixCommunicateSocket, UnixCommunicateSocket> CreateSocketPair() throw(DWORD) {
+        static std::atomic<unsigned> sequence(0);
+
+        ULONGLONG nonce = 0;
+        if (!BCRYPT_SUCCESS(::BCryptGenRandom(nullptr, reinterpret_cast<PUCHAR>(&nonce), sizeof(nonce),
+                                              BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+            throw static_cast<DWORD>(NTE_FAIL);
+
+        char directory[MAX_PATH + 1];
+        DWORD length = ::GetTempPathA(sizeof(directory), directory);
+        if (length == 0 || length > MAX_PATH)
+            throw ::GetLastError();
+
+        SocketAddr<AF_UNIX> address;
+        memset(static_cast<sockaddr_un*>(&address), 0, sizeof(sockaddr_un));
+        address.sun_family = AF_UNIX;
+        int written = snprintf(address.sun_path, sizeof(address.sun_path), "%stinysocket-%lu-%u-%016llx.sock",
+                               directory, ::GetCurrentProcessId(), sequence++, nonce);
+        if (written < 0 || written >= static_cast<int>(sizeof(address.sun_path)))
+            throw WSAENAMETOOLONG;
+
+        UnixListenSocket listener;
+        listener.Bind(address);
+        try {
+            listener.Listen(1);
+            UnixCommunicateSocket first;
+            first.Connect(address);
+            UnixCommunicateSocket second = listener.Accept();
+            if (second.GetPeerProcessId() != ::GetCurrentProcessId())
+                throw WSAEACCES;
+            ::DeleteFileA(address.sun_path);
+            return std::make_pair(std::move(first), std::move(second));
+        } catch (...) {
+            ::DeleteFileA(address.sun_path);
+            throw;
+        }
+    }
+
+}